@@ -3,8 +3,18 @@
  */
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <string.h> // for memset()
 #include <assert.h>
 #include <stdio.h> // for perror()
+#include <stdatomic.h> // for the POOL_THREAD_SAFE locks, the parked flags
+
+// the spin locks pause between tries on x86-64
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define MEM_PAUSE_X86
+#include <immintrin.h>
+#endif
 
 #include "mem_pool.h"
 
@@ -13,21 +23,71 @@
 /* Constants */
 /*           */
 /*************/
-static const float      MEM_FILL_FACTOR                 = 0.75;
-static const unsigned   MEM_EXPAND_FACTOR               = 2;
-
 static const unsigned   MEM_POOL_STORE_INIT_CAPACITY    = 20;
 static const float      MEM_POOL_STORE_FILL_FACTOR      = 0.75;
 static const unsigned   MEM_POOL_STORE_EXPAND_FACTOR    = 2;
+// the pool store grows by chunks that never move (an array dimension)
+#define MEM_POOL_STORE_CHUNKS   32
 
 static const unsigned   MEM_NODE_HEAP_INIT_CAPACITY     = 40;
 static const float      MEM_NODE_HEAP_FILL_FACTOR       = 0.75;
 static const unsigned   MEM_NODE_HEAP_EXPAND_FACTOR     = 2;
+// the node heap grows by chunks that never move (an array dimension)
+#define MEM_NODE_HEAP_CHUNKS    32
 
 static const unsigned   MEM_GAP_IX_INIT_CAPACITY        = 40;
 static const float      MEM_GAP_IX_FILL_FACTOR          = 0.75;
 static const unsigned   MEM_GAP_IX_EXPAND_FACTOR        = 2;
 
+static const unsigned   MEM_ALLOC_IX_INIT_CAPACITY      = 64; // power of 2
+static const float      MEM_ALLOC_IX_FILL_FACTOR        = 0.5; // probing
+static const unsigned   MEM_ALLOC_IX_EXPAND_FACTOR      = 2;
+static const unsigned   MEM_ALLOC_IX_NIL                = (unsigned) -1;
+
+static const unsigned   MEM_GAP_NIL                     = (unsigned) -1;
+static const unsigned   MEM_NODE_NIL                    = (unsigned) -1;
+
+// a node keeps its gap index slot in the bits its flags leave over
+// (a bit-field width, so it has to be a macro)
+#define MEM_NODE_GAP_BITS       30
+static const unsigned   MEM_NODE_GAP_NIL                =
+        (1u << MEM_NODE_GAP_BITS) - 1;
+
+// gap size classes: sizes below MEM_GAP_CLASS_SUBS get a class each, every
+// larger power of two is split into MEM_GAP_CLASS_SUBS equal sub-classes
+// (these are array dimensions, so they have to be macros)
+#define MEM_GAP_CLASS_SUB_BITS  3
+#define MEM_GAP_CLASS_SUBS      (1u << MEM_GAP_CLASS_SUB_BITS)
+#define MEM_GAP_CLASS_GROUPS    (64 - MEM_GAP_CLASS_SUB_BITS + 1)
+#define MEM_GAP_NUM_CLASSES     (MEM_GAP_CLASS_GROUPS * MEM_GAP_CLASS_SUBS)
+
+// buddy blocks are 2^order bytes, the smallest one holds the free list links
+#define MEM_BUDDY_ORDERS        64
+static const unsigned   MEM_BUDDY_MIN_ORDER             = 4;
+static const uint8_t    MEM_BUDDY_ALLOCATED             = 0x80;
+
+// a lock gets a cache line to itself (an array dimension)
+#define MEM_CACHE_LINE          64
+
+// POOL_THREAD_CACHE: blocks of up to MEM_CACHE_CLASSES * MEM_CACHE_GRAIN
+// bytes, one class per grain, are kept per thread (array dimensions)
+#define MEM_CACHE_CLASSES       16
+#define MEM_CACHE_DEPTH         8 // blocks kept per class
+#define MEM_CACHE_BATCH         16 // deallocations deferred per trip
+#define MEM_THREAD_CACHE_SLOTS  8 // pools a thread finds its cache for fast
+static const size_t     MEM_CACHE_GRAIN                 = 16;
+static const unsigned   MEM_CACHE_REFILL                = 4;
+static const unsigned   MEM_CACHE_NONE                  = (unsigned) -1;
+
+// POOL_REMOTE_FREE: a queued deallocation links to the next in the block
+static const size_t     MEM_REMOTE_MIN_SIZE             = sizeof(char *);
+
+// marks: the log of the allocations made since the first mark
+static const size_t     MEM_MARK_LOG_INIT_CAPACITY      = 64;
+static const size_t     MEM_MARK_LOG_EXPAND_FACTOR      = 2;
+static const unsigned   MEM_MARK_STACK_INIT_CAPACITY    = 8;
+static const size_t     MEM_MARK_NONE                   = (size_t) -1;
+
 
 
 /*********************/
@@ -35,30 +95,139 @@ static const unsigned   MEM_GAP_IX_EXPAND_FACTOR        = 2;
 /* Type declarations */
 /*                   */
 /*********************/
-typedef struct _alloc {
-    char *mem;
-    size_t size;
-} alloc_t, *alloc_pt;
+// segment offsets and sizes, 32 bits wide in a compact build
+// (pools are then limited to 4 GiB - 1)
+#ifdef MEM_POOL_COMPACT
+typedef uint32_t mem_off_t;
+#else
+typedef size_t mem_off_t;
+#endif
+
+// a pool store entry, cleared by mem_pool_close while others may look
+typedef _Atomic(struct _pool_mgr *) pool_slot_t, *pool_slot_pt;
 
 typedef struct _node {
-    alloc_t alloc_record;
-    unsigned used;
-    unsigned allocated;
-    struct _node *next, *prev; // doubly-linked list for gap deletion
+    mem_off_t offset; // of the segment, from pool.mem
+    mem_off_t size;
+    unsigned next, prev; // doubly-linked list of node indices, for gap
+                         // deletion (next links the unused nodes, if unused)
+    unsigned gap : MEM_NODE_GAP_BITS; // slot in the gap index, if a gap
+    unsigned used : 1;
+    unsigned allocated : 1;
+    atomic_uchar parked; // allocated, but held by a thread cache
 } node_t, *node_pt;
 
+typedef enum _gap_ix_kind {
+    GAP_IX_CLASSES,     // size class tries, by (size, mem)
+    GAP_IX_TLSF,        // size class tries, skipping the requested class
+    GAP_IX_SIZE_TREE,   // gap tree, by (size, mem)
+    GAP_IX_ADDR_TREE    // gap tree, by mem, with the largest gap per subtree
+} gap_ix_kind;
+
 typedef struct _gap {
-    size_t size;
-    node_pt node;
+    mem_off_t size;
+    unsigned node; // node index
+    union {
+        struct { unsigned next, prev; }; // free slot list
+        struct { unsigned left, right; }; // gap tree or size class trie
+    };
+    unsigned up; // size class trie only, MEM_GAP_NIL at the root
+    unsigned height; // gap tree only
+    mem_off_t max_size; // gap tree only, largest gap in the subtree
+    mem_off_t min_size; // gap tree only, smallest gap in the subtree
 } gap_t, *gap_pt;
 
+typedef struct _buddy {
+    struct _buddy *next, *prev; // free list of the order, inside the block
+} buddy_t, *buddy_pt;
+
+// a spin lock padded on both sides, so no other data shares its cache line
+typedef struct _mem_lock {
+    char pad_before[MEM_CACHE_LINE];
+    atomic_uint held;
+    char pad_after[MEM_CACHE_LINE - sizeof(atomic_uint)];
+} mem_lock_t, *mem_lock_pt;
+
+// the blocks a thread keeps for a POOL_THREAD_CACHE pool, still allocated
+// in the pool; only the owner thread takes the lock, except to flush
+typedef struct _mem_cache {
+    mem_lock_t lock;
+    struct _mem_cache *next; // the pool's list of caches
+    const char *owner; // thread_token of the owner thread
+    unsigned count[MEM_CACHE_CLASSES];
+    char *blocks[MEM_CACHE_CLASSES][MEM_CACHE_DEPTH];
+    atomic_uchar *parked[MEM_CACHE_CLASSES][MEM_CACHE_DEPTH]; // their flags
+    unsigned num_freed;
+    char *freed[MEM_CACHE_BATCH]; // deallocated, their sizes not looked up yet
+} mem_cache_t, *mem_cache_pt;
+
+typedef struct _mem_cache_slot {
+    const void *pool_mgr;
+    unsigned long serial; // of the pool, in case another takes its address
+    mem_cache_pt cache;
+} mem_cache_slot_t, *mem_cache_slot_pt;
+
+// deallocations from other threads than the owner of a POOL_REMOTE_FREE
+// pool, linked through the blocks, on a cache line of their own
+typedef struct _mem_queue {
+    char pad_before[MEM_CACHE_LINE];
+    _Atomic(char *) head; // pushed with one CAS, taken all at once
+    char pad_after[MEM_CACHE_LINE - sizeof(_Atomic(char *))];
+} mem_queue_t, *mem_queue_pt;
+
 typedef struct _pool_mgr {
     pool_t pool;
-    node_pt node_heap;
+    unsigned flags;
+    gap_ix_kind gap_ix_kind;
+    node_pt node_heap[MEM_NODE_HEAP_CHUNKS]; // chunks, the head node first
+    unsigned node_chunks;
     unsigned total_nodes;
     unsigned used_nodes;
+    unsigned unused_nodes; // list of unused nodes, last in first out
+    unsigned fresh_node; // first node never handed out, since open or reset
+    unsigned rover; // NEXT_FIT: node of the last allocation
+    unsigned *alloc_ix; // allocation nodes, open addressing by offset
+    unsigned alloc_ix_capacity;
     gap_pt gap_ix;
     unsigned gap_ix_capacity;
+    unsigned gap_ix_free; // head of the list of unused gap index slots
+    unsigned gap_class[MEM_GAP_NUM_CLASSES]; // roots of the size class tries
+    unsigned gap_offset_bits; // size class tries: bits of a segment offset
+    uint64_t gap_group_map; // groups with at least one non-empty class
+    uint8_t gap_class_map[MEM_GAP_CLASS_GROUPS]; // non-empty classes per group
+    unsigned gap_root; // root of the gap tree, if any
+    uint8_t *buddy_map; // BUDDY: order (| allocated) at each block start
+    atomic_uchar *buddy_parked; // BUDDY, POOL_THREAD_CACHE: at each block start
+    size_t buddy_size; // BUDDY: bytes covered by blocks
+    buddy_pt buddy_free[MEM_BUDDY_ORDERS]; // BUDDY: free lists per order
+    uint64_t buddy_free_map; // BUDDY: orders with free blocks
+    size_t slab_block; // SLAB: block size
+    size_t slab_count; // SLAB: number of blocks
+    size_t slab_next; // SLAB: first block never handed out
+    char *slab_free; // SLAB: free list of returned blocks, inside the blocks
+    uint64_t *slab_map; // SLAB: one bit per block, set if allocated
+    size_t small_gap_threshold; // gaps below this many bytes are counted
+    size_t small_gap_size; // bytes in such gaps, except in a SLAB pool
+    mem_lock_t lock; // POOL_THREAD_SAFE: held for every call on the pool
+    unsigned long serial; // unique among all the pools ever opened
+    mem_lock_t cache_lock; // POOL_THREAD_CACHE: held to walk the caches
+    mem_cache_pt caches; // POOL_THREAD_CACHE: one per thread
+    unsigned long late_fails; // deferred deallocations found bad since
+                              // the last mem_pool_flush_caches
+    const char *owner; // thread_token of the thread that opened the pool
+    mem_queue_t remote_frees; // POOL_REMOTE_FREE: from the other threads
+    struct _pool_mgr **shards; // sharded: the shards, in address order
+    unsigned num_shards; // sharded: 0 if the pool is not sharded
+    size_t shard_size; // sharded: of every shard but the last
+    struct _pool_mgr *parent; // a shard: the sharded pool, owns pool.mem
+    int marked; // logging the allocations, while any mark is outstanding
+    char **mark_log; // marked: the allocations, in the order they were made
+    size_t mark_log_size;
+    size_t mark_log_capacity;
+    size_t *mark_stack; // the depths of the outstanding marks, outermost first
+    unsigned num_marks;
+    unsigned mark_stack_capacity;
+    unsigned long mark_epoch; // log restarts so far, marks from before are void
 } pool_mgr_t, *pool_mgr_pt;
 
 
@@ -68,9 +237,20 @@ typedef struct _pool_mgr {
 /* Static global variables */
 /*                         */
 /***************************/
-static pool_mgr_pt *pool_store = NULL; // an array of pointers, only expand
-static unsigned pool_store_size = 0;
+// chunks of pointers, only expand, and the chunks never move, so that
+// lookups take no lock
+static pool_slot_pt pool_store[MEM_POOL_STORE_CHUNKS];
+static atomic_uint pool_store_size = 0; // raised once the pool is stored
+static unsigned pool_store_chunks = 0;
 static unsigned pool_store_capacity = 0;
+static mem_lock_t pool_store_lock; // held to add a pool
+static unsigned long pool_serial = 0; // of the last pool opened
+// each thread's caches of POOL_THREAD_CACHE pools, by pool serial
+static _Thread_local mem_cache_slot_t thread_caches[MEM_THREAD_CACHE_SLOTS];
+static _Thread_local char thread_token; // its address tells threads apart
+// each thread's home shard in a sharded pool, by ticket, 0 until drawn
+static atomic_uint shard_ticket;
+static _Thread_local unsigned thread_shard;
 
 
 
@@ -80,18 +260,164 @@ static unsigned pool_store_capacity = 0;
 /*                                          */
 /********************************************/
 static alloc_status _mem_resize_pool_store();
-static alloc_status _mem_resize_node_heap(pool_mgr_pt pool_mgr);
+static pool_slot_pt _mem_store_slot(unsigned ix);
+static pool_mgr_pt _mem_pool_create(size_t size,
+                                    alloc_policy policy,
+                                    unsigned flags,
+                                    char *mem);
+static alloc_status _mem_store_pool(pool_mgr_pt pool_mgr);
+static void _mem_free_pool(pool_mgr_pt pool_mgr);
+static void _mem_lock(mem_lock_pt lock);
+static void _mem_unlock(mem_lock_pt lock);
+static void _mem_lock_pool(pool_mgr_pt pool_mgr);
+static void _mem_unlock_pool(pool_mgr_pt pool_mgr);
+static void * _mem_pool_alloc(pool_mgr_pt pool_mgr, size_t size);
+static alloc_status _mem_pool_free(pool_mgr_pt pool_mgr, void *alloc);
+static size_t _mem_alloc_size(pool_mgr_pt pool_mgr, char *alloc);
+static unsigned _mem_cache_class(pool_mgr_pt pool_mgr,
+                                 size_t size,
+                                 size_t *rounded);
+static mem_cache_pt _mem_thread_cache(pool_mgr_pt pool_mgr);
+static void * _mem_cache_alloc(pool_mgr_pt pool_mgr, size_t size);
+static alloc_status _mem_cache_free(pool_mgr_pt pool_mgr, void *alloc);
+static void _mem_cache_keep(pool_mgr_pt pool_mgr,
+                            mem_cache_pt cache,
+                            unsigned c,
+                            char *block);
+static void _mem_cache_sort_freed(pool_mgr_pt pool_mgr, mem_cache_pt cache);
+static void _mem_cache_flush(pool_mgr_pt pool_mgr, mem_cache_pt cache);
+static atomic_uchar * _mem_parked_flag(pool_mgr_pt pool_mgr, char *alloc);
+static int _mem_is_parked(pool_mgr_pt pool_mgr, char *alloc);
+static void _mem_flush_caches(pool_mgr_pt pool_mgr);
+static int _mem_remote_fits(pool_mgr_pt pool_mgr, const char *alloc);
+static void _mem_push_remote_free(pool_mgr_pt pool_mgr, char *alloc);
+static void _mem_drain_remote_frees(pool_mgr_pt pool_mgr);
+static void _mem_flush_parked(pool_mgr_pt pool_mgr);
+static void _mem_drop_parked(pool_mgr_pt pool_mgr);
+static alloc_status _mem_pool_reset(pool_mgr_pt pool_mgr);
+static pool_mgr_pt _mem_shard_of(pool_mgr_pt pool_mgr, char *alloc);
+static void _mem_shard_sum(pool_mgr_pt pool_mgr,
+                           pool_mgr_pt shard,
+                           const pool_t *before);
+static unsigned _mem_home_shard(pool_mgr_pt pool_mgr);
+static void * _mem_shard_alloc(pool_mgr_pt pool_mgr, size_t size);
+static alloc_status _mem_shard_free(pool_mgr_pt pool_mgr, void *alloc);
+static alloc_status _mem_batch_alloc(pool_mgr_pt pool_mgr,
+                                     const size_t *sizes,
+                                     size_t n,
+                                     void **out,
+                                     size_t min_size);
+static void _mem_restore_rover(pool_mgr_pt pool_mgr,
+                               size_t offset,
+                               int allocated);
+static alloc_status _mem_carve_batch(pool_mgr_pt pool_mgr,
+                                     const size_t *sizes,
+                                     size_t n,
+                                     void **out,
+                                     size_t min_size,
+                                     size_t total);
+static alloc_status _mem_batch_free(pool_mgr_pt pool_mgr,
+                                    char **allocs,
+                                    size_t n);
+static int _mem_compare_allocs(const void *a, const void *b);
+static alloc_status _mem_resize_mark_log(pool_mgr_pt pool_mgr, size_t extra);
+static alloc_status _mem_resize_mark_stack(pool_mgr_pt pool_mgr);
+static int _mem_mark_is_valid(pool_mgr_pt pool_mgr, pool_mark_t mark);
+static size_t _mem_compact_mark_log(pool_mgr_pt pool_mgr, size_t depth);
+static alloc_status _mem_release_mark_log(pool_mgr_pt pool_mgr, size_t depth);
+static alloc_status _mem_realloc_in_place(pool_mgr_pt pool_mgr,
+                                          char *alloc,
+                                          size_t size);
+static void * _mem_node_alloc(pool_mgr_pt pool_mgr, size_t size);
+static alloc_status _mem_node_free(pool_mgr_pt pool_mgr, void *alloc);
+static alloc_status _mem_node_realloc(pool_mgr_pt pool_mgr,
+                                      char *alloc,
+                                      size_t size);
+static unsigned _mem_find_gap(pool_mgr_pt pool_mgr, size_t size);
+static alloc_status _mem_resize_node_heap(pool_mgr_pt pool_mgr,
+                                          unsigned extra);
 static alloc_status _mem_resize_gap_ix(pool_mgr_pt pool_mgr);
+static node_pt _mem_node(pool_mgr_pt pool_mgr, unsigned ix);
+static unsigned _mem_get_unused_node(pool_mgr_pt pool_mgr);
+static void _mem_put_unused_node(pool_mgr_pt pool_mgr, unsigned ix);
 static alloc_status
         _mem_add_to_gap_ix(pool_mgr_pt pool_mgr,
                            size_t size,
-                           node_pt node);
+                           unsigned node);
 static alloc_status
         _mem_remove_from_gap_ix(pool_mgr_pt pool_mgr,
                                 size_t size,
-                                node_pt node);
-static alloc_status _mem_sort_gap_ix(pool_mgr_pt pool_mgr);
+                                unsigned node);
+static alloc_status _mem_resize_alloc_ix(pool_mgr_pt pool_mgr,
+                                         unsigned extra);
+static void _mem_add_to_alloc_ix(pool_mgr_pt pool_mgr, unsigned node);
+static void _mem_remove_from_alloc_ix(pool_mgr_pt pool_mgr, unsigned node);
+static unsigned _mem_find_in_alloc_ix(pool_mgr_pt pool_mgr, size_t offset);
+static unsigned _mem_hash_alloc_ix(pool_mgr_pt pool_mgr, size_t offset);
+static unsigned _mem_find_in_gap_ix(pool_mgr_pt pool_mgr, size_t size);
+static unsigned _mem_find_first_in_gap_ix(pool_mgr_pt pool_mgr, size_t size);
+static unsigned _mem_find_good_in_gap_ix(pool_mgr_pt pool_mgr, size_t size);
+static unsigned _mem_find_next_in_gap_ix(pool_mgr_pt pool_mgr,
+                                         unsigned root,
+                                         size_t size,
+                                         size_t from);
 static alloc_status _mem_invalidate_gap_ix(pool_mgr_pt pool_mgr);
+static unsigned _mem_gap_class(size_t size);
+static unsigned _mem_next_gap_class(pool_mgr_pt pool_mgr, unsigned size_class);
+static void _mem_insert_class_trie(pool_mgr_pt pool_mgr, unsigned slot);
+static void _mem_remove_class_trie(pool_mgr_pt pool_mgr, unsigned slot);
+static unsigned _mem_bound_class_trie(pool_mgr_pt pool_mgr,
+                                      unsigned size_class,
+                                      size_t size);
+static unsigned _mem_class_trie_end(pool_mgr_pt pool_mgr,
+                                    unsigned slot,
+                                    int last);
+static unsigned _mem_class_trie_bit(pool_mgr_pt pool_mgr,
+                                    size_t size,
+                                    size_t offset,
+                                    unsigned depth);
+static void _mem_mark_gap_class(pool_mgr_pt pool_mgr,
+                                unsigned size_class,
+                                int nonempty);
+static unsigned
+        _mem_insert_gap_tree(pool_mgr_pt pool_mgr,
+                             unsigned root,
+                             unsigned slot);
+static unsigned
+        _mem_remove_gap_tree(pool_mgr_pt pool_mgr,
+                             unsigned root,
+                             unsigned slot);
+static unsigned _mem_balance_gap_tree(pool_mgr_pt pool_mgr, unsigned root);
+static unsigned _mem_rotate_gap_tree(pool_mgr_pt pool_mgr,
+                                     unsigned root,
+                                     int left);
+static void _mem_update_gap_tree(pool_mgr_pt pool_mgr, unsigned slot);
+static int _mem_gap_before(pool_mgr_pt pool_mgr, unsigned a, unsigned b);
+static alloc_status _mem_buddy_init(pool_mgr_pt pool_mgr);
+static void _mem_buddy_reset(pool_mgr_pt pool_mgr);
+static void * _mem_buddy_alloc(pool_mgr_pt pool_mgr, size_t size);
+static alloc_status _mem_buddy_free(pool_mgr_pt pool_mgr, void *alloc);
+static alloc_status _mem_buddy_realloc(pool_mgr_pt pool_mgr,
+                                       char *alloc,
+                                       size_t size);
+static void _mem_buddy_push(pool_mgr_pt pool_mgr, size_t offset,
+                            unsigned order);
+static void _mem_buddy_remove(pool_mgr_pt pool_mgr, size_t offset,
+                              unsigned order);
+static void * _mem_slab_alloc(pool_mgr_pt pool_mgr, size_t size);
+static alloc_status _mem_slab_free(pool_mgr_pt pool_mgr, void *alloc);
+static alloc_status _mem_next_segment(pool_mgr_pt pool_mgr,
+                                      pool_cursor_pt cursor,
+                                      pool_segment_pt segment);
+static alloc_status _mem_foreach_segment(pool_mgr_pt pool_mgr,
+                                         pool_segment_visitor visitor,
+                                         void *ctx);
+static void _mem_gap_extremes(pool_mgr_pt pool_mgr,
+                              size_t *smallest,
+                              size_t *largest);
+static int _mem_count_small_gap(const pool_segment_t *segment, void *ctx);
+static unsigned _mem_ctz(uint64_t bits);
+static unsigned _mem_msb(uint64_t bits);
 
 
 
@@ -102,149 +428,687 @@ static alloc_status _mem_invalidate_gap_ix(pool_mgr_pt pool_mgr);
 /****************************************/
 alloc_status mem_init() {
     // ensure that it's called only once until mem_free
+    if (pool_store[0] != NULL) return ALLOC_CALLED_AGAIN;
+
     // allocate the pool store with initial capacity
     // note: holds pointers only, other functions to allocate/deallocate
+    pool_store[0] = (pool_slot_pt) calloc(MEM_POOL_STORE_INIT_CAPACITY,
+                                          sizeof(pool_slot_t));
+    if (pool_store[0] == NULL) {
+        perror("mem_init");
+        return ALLOC_FAIL;
+    }
+    pool_store_size = 0;
+    pool_store_chunks = 1;
+    pool_store_capacity = MEM_POOL_STORE_INIT_CAPACITY;
 
-    return ALLOC_FAIL;
+    return ALLOC_OK;
 }
 
 alloc_status mem_free() {
     // ensure that it's called only once for each mem_init
+    if (pool_store[0] == NULL) return ALLOC_CALLED_AGAIN;
+
     // make sure all pool managers have been deallocated
-    // can free the pool store array
+    for (unsigned u = 0; u < pool_store_size; u ++)
+        if (*_mem_store_slot(u) != NULL) return ALLOC_NOT_FREED;
+
+    // can free the pool store, chunk by chunk
+    for (unsigned u = 0; u < pool_store_chunks; u ++) {
+        free(pool_store[u]);
+        pool_store[u] = NULL;
+    }
+
     // update static variables
+    pool_store_size = 0;
+    pool_store_chunks = 0;
+    pool_store_capacity = 0;
 
-    return ALLOC_FAIL;
+    return ALLOC_OK;
 }
 
 pool_pt mem_pool_open(size_t size, alloc_policy policy) {
+    return mem_pool_open_ex(size, policy, 0);
+}
+
+pool_pt mem_pool_open_ex(size_t size, alloc_policy policy, unsigned flags) {
     // make sure there the pool store is allocated
-    // expand the pool store, if necessary
-    // allocate a new mem pool mgr
-    // check success, on error return null
-    // allocate a new memory pool
-    // check success, on error deallocate mgr and return null
-    // allocate a new node heap
-    // check success, on error deallocate mgr/pool and return null
-    // allocate a new gap index
-    // check success, on error deallocate mgr/pool/heap and return null
-    // assign all the pointers and update meta data:
-    //   initialize top node of node heap
-    //   initialize top node of gap index
-    //   initialize pool mgr
-    //   link pool mgr to pool store
+    if (pool_store[0] == NULL) return NULL;
+    if (size == 0 || size > (mem_off_t) -1) return NULL;
+    switch (policy) {
+        case FIRST_FIT:
+        case BEST_FIT:
+        case TLSF:
+        case BUDDY:
+        case NEXT_FIT:
+            break;
+        default:
+            return NULL; // SLAB pools come from mem_pool_open_fixed
+    }
+    if (flags & ~(unsigned) (POOL_GAP_TREE | POOL_THREAD_SAFE
+                             | POOL_THREAD_CACHE | POOL_REMOTE_FREE))
+        return NULL;
+    // the caches go back to the pool from any thread
+    if (flags & POOL_THREAD_CACHE) flags |= POOL_THREAD_SAFE;
+
+    pool_mgr_pt pool_mgr = _mem_pool_create(size, policy, flags, NULL);
+    if (pool_mgr == NULL) return NULL;
+
+    // link pool mgr to pool store
+    pool_mgr->owner = &thread_token;
+    if (_mem_store_pool(pool_mgr) != ALLOC_OK) {
+        _mem_free_pool(pool_mgr);
+        return NULL;
+    }
+
     // return the address of the mgr, cast to (pool_pt)
+    return (pool_pt) pool_mgr;
+}
+
+pool_pt mem_pool_open_fixed(size_t block_size, size_t count) {
+    // make sure there the pool store is allocated
+    if (pool_store[0] == NULL) return NULL;
+    if (block_size == 0 || count == 0 || count > UINT_MAX) return NULL;
+
+    // every block has to hold a free list link and keep it aligned
+    size_t align = sizeof(char *);
+    if (block_size > SIZE_MAX - align) return NULL;
+    block_size = (block_size + align - 1) / align * align;
+    if (block_size > SIZE_MAX / count) return NULL;
+
+    // allocate a new mem pool mgr
+    pool_mgr_pt pool_mgr = (pool_mgr_pt) calloc(1, sizeof(pool_mgr_t));
+    if (pool_mgr == NULL) {
+        perror("mem_pool_open_fixed");
+        return NULL;
+    }
+
+    // allocate a new memory pool and its block map
+    pool_mgr->pool.mem = (char *) malloc(block_size * count);
+    pool_mgr->slab_map = (uint64_t *) calloc((count + 63) / 64,
+                                             sizeof(uint64_t));
+    if (pool_mgr->pool.mem == NULL || pool_mgr->slab_map == NULL) {
+        perror("mem_pool_open_fixed");
+        free(pool_mgr->slab_map);
+        free(pool_mgr->pool.mem);
+        free(pool_mgr);
+        return NULL;
+    }
 
-    return NULL;
+    // the blocks are handed out in order first, so there is no list to build
+    pool_mgr->pool.policy = SLAB;
+    pool_mgr->pool.total_size = block_size * count;
+    pool_mgr->pool.num_gaps = (unsigned) count;
+    pool_mgr->slab_block = block_size;
+    pool_mgr->slab_count = count;
+    pool_mgr->slab_next = 0;
+    pool_mgr->slab_free = NULL;
+
+    // link pool mgr to pool store
+    if (_mem_store_pool(pool_mgr) != ALLOC_OK) {
+        _mem_free_pool(pool_mgr);
+        return NULL;
+    }
+
+    return (pool_pt) pool_mgr;
+}
+
+pool_pt mem_pool_open_sharded(size_t size,
+                              alloc_policy policy,
+                              unsigned shards) {
+    // make sure there the pool store is allocated
+    if (pool_store[0] == NULL) return NULL;
+    if (size == 0 || size > (mem_off_t) -1 || shards == 0) return NULL;
+    // the policies of mem_pool_open_ex
+    if (policy == SLAB || (unsigned) policy > NEXT_FIT) return NULL;
+
+    // every shard starts on a cache line of its own
+    size_t shard_size = size / shards / MEM_CACHE_LINE * MEM_CACHE_LINE;
+    if (shard_size == 0) return NULL;
+
+    // allocate a new mem pool mgr, the memory pool and the shard array
+    pool_mgr_pt pool_mgr = (pool_mgr_pt) calloc(1, sizeof(pool_mgr_t));
+    if (pool_mgr == NULL) {
+        perror("mem_pool_open_sharded");
+        return NULL;
+    }
+    pool_mgr->pool.mem = (char *) malloc(size);
+    pool_mgr->shards = (pool_mgr_pt *) calloc(shards, sizeof(pool_mgr_pt));
+    if (pool_mgr->pool.mem == NULL || pool_mgr->shards == NULL) {
+        perror("mem_pool_open_sharded");
+        free(pool_mgr->shards);
+        free(pool_mgr->pool.mem);
+        free(pool_mgr);
+        return NULL;
+    }
+
+    // the lock of the sharded pool guards only its summed metadata
+    pool_mgr->flags = POOL_THREAD_SAFE;
+    pool_mgr->pool.policy = policy;
+    pool_mgr->pool.total_size = size;
+    pool_mgr->num_shards = shards;
+    pool_mgr->shard_size = shard_size;
+
+    // each shard is a pool of its own, on its part of the memory pool
+    for (unsigned u = 0; u < shards; u ++) {
+        size_t offset = u * shard_size;
+        size_t part = (u + 1 < shards) ? shard_size : size - offset;
+        pool_mgr_pt shard = _mem_pool_create(part, policy, POOL_THREAD_SAFE,
+                                             pool_mgr->pool.mem + offset);
+        if (shard == NULL) {
+            _mem_free_pool(pool_mgr);
+            return NULL;
+        }
+        shard->parent = pool_mgr;
+        pool_mgr->shards[u] = shard;
+        pool_mgr->pool.num_gaps += shard->pool.num_gaps;
+    }
+
+    // link pool mgr to pool store
+    pool_mgr->owner = &thread_token;
+    if (_mem_store_pool(pool_mgr) != ALLOC_OK) {
+        _mem_free_pool(pool_mgr);
+        return NULL;
+    }
+
+    return (pool_pt) pool_mgr;
 }
 
 alloc_status mem_pool_close(pool_pt pool) {
     // get mgr from pool by casting the pointer to (pool_mgr_pt)
+    pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+
     // check if this pool is allocated
+    // (without the store lock: a pool is counted only once it is stored)
+    if (pool_store[0] == NULL || pool_mgr == NULL) return ALLOC_FAIL;
+    unsigned size = atomic_load_explicit(&pool_store_size,
+                                         memory_order_acquire);
+    unsigned ix = 0;
+    while (ix < size
+           && atomic_load_explicit(_mem_store_slot(ix),
+                                   memory_order_relaxed) != pool_mgr)
+        ix ++;
+    if (ix == size) return ALLOC_FAIL;
+
+    // the blocks in the thread caches are not really allocated
+    _mem_flush_parked(pool_mgr);
+
     // check if pool has only one gap
+    // (an empty buddy pool is one free block per set bit of its size,
+    // an empty slab pool is all free blocks, an empty sharded pool is a
+    // gap per shard, at least)
     // check if it has zero allocations
-    // free memory pool
-    // free node heap
-    // free gap index
-    // find mgr in pool store and set to null
+    if ((pool->policy != BUDDY && pool->policy != SLAB
+         && pool_mgr->num_shards == 0 && pool->num_gaps != 1)
+        || pool->num_allocs != 0)
+        return ALLOC_NOT_FREED;
+
+    // find mgr in pool store and set to null, unless another close got
+    // there first, then only that one frees the pool
     // note: don't decrement pool_store_size, because it only grows
-    // free mgr
+    pool_mgr_pt expected = pool_mgr;
+    if (! atomic_compare_exchange_strong_explicit(_mem_store_slot(ix),
+                                                  &expected, NULL,
+                                                  memory_order_acq_rel,
+                                                  memory_order_relaxed))
+        return ALLOC_FAIL;
+
+    // free memory pool, its indexes and the mgr
+    _mem_free_pool(pool_mgr);
 
-    return ALLOC_FAIL;
+    return ALLOC_OK;
 }
 
 void * mem_new_alloc(pool_pt pool, size_t size) {
     // get mgr from pool by casting the pointer to (pool_mgr_pt)
-    // check if any gaps, return null if none
-    // expand heap node, if necessary, quit on error
-    // check used nodes fewer than total nodes, quit on error
-    // get a node for allocation:
-    // if FIRST_FIT, then find the first sufficient node in the node heap
-    // if BEST_FIT, then find the first sufficient node in the gap index
-    // check if node found
-    // update metadata (num_allocs, alloc_size)
-    // calculate the size of the remaining gap, if any
-    // remove node from gap index
-    // convert gap_node to an allocation node of given size
-    // adjust node heap:
-    //   if remaining gap, need a new node
-    //   find an unused one in the node heap
-    //   make sure one was found
-    //   initialize it to a gap node
-    //   update metadata (used_nodes)
-    //   update linked list (new node right after the node for allocation)
-    //   add to gap index
-    //   check if successful
-    // return allocation record by casting the node to (alloc_pt)
+    pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+    void *alloc;
 
-    return NULL;
+    if (pool_mgr->num_shards > 0) return _mem_shard_alloc(pool_mgr, size);
+    if (pool_mgr->flags & POOL_REMOTE_FREE) {
+        // the owner takes back what the other threads deallocated
+        if (pool_mgr->owner == &thread_token) _mem_drain_remote_frees(pool_mgr);
+        // and every block has to have room for the queue link
+        if (size > 0 && size < MEM_REMOTE_MIN_SIZE) size = MEM_REMOTE_MIN_SIZE;
+    }
+    if (pool_mgr->flags & POOL_THREAD_CACHE)
+        return _mem_cache_alloc(pool_mgr, size);
+
+    _mem_lock_pool(pool_mgr);
+    if (pool_mgr->marked && _mem_resize_mark_log(pool_mgr, 1) != ALLOC_OK) {
+        _mem_unlock_pool(pool_mgr);
+        return NULL;
+    }
+    alloc = _mem_pool_alloc(pool_mgr, size);
+    if (alloc != NULL && pool_mgr->marked)
+        pool_mgr->mark_log[pool_mgr->mark_log_size ++] = alloc;
+    _mem_unlock_pool(pool_mgr);
+
+    return alloc;
 }
 
 alloc_status mem_del_alloc(pool_pt pool, void * alloc) {
     // get mgr from pool by casting the pointer to (pool_mgr_pt)
-    // get node from alloc by casting the pointer to (node_pt)
-    // find the node in the node heap
-    // this is node-to-delete
-    // make sure it's found
-    // convert to gap node
-    // update metadata (num_allocs, alloc_size)
-    // if the next node in the list is also a gap, merge into node-to-delete
-    //   remove the next node from gap index
-    //   check success
-    //   add the size to the node-to-delete
-    //   update node as unused
-    //   update metadata (used nodes)
-    //   update linked list:
-    /*
-                    if (next->next) {
-                        next->next->prev = node_to_del;
-                        node_to_del->next = next->next;
-                    } else {
-                        node_to_del->next = NULL;
-                    }
-                    next->next = NULL;
-                    next->prev = NULL;
-     */
+    pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+    alloc_status status;
 
-    // this merged node-to-delete might need to be added to the gap index
-    // but one more thing to check...
-    // if the previous node in the list is also a gap, merge into previous!
-    //   remove the previous node from gap index
-    //   check success
-    //   add the size of node-to-delete to the previous
-    //   update node-to-delete as unused
-    //   update metadata (used_nodes)
-    //   update linked list
-    /*
-                    if (node_to_del->next) {
-                        prev->next = node_to_del->next;
-                        node_to_del->next->prev = prev;
-                    } else {
-                        prev->next = NULL;
-                    }
-                    node_to_del->next = NULL;
-                    node_to_del->prev = NULL;
-     */
-    //   change the node to add to the previous node!
-    // add the resulting node to the gap index
-    // check success
+    if (pool_mgr->num_shards > 0) return _mem_shard_free(pool_mgr, alloc);
+    if ((pool_mgr->flags & POOL_REMOTE_FREE)
+        && pool_mgr->owner != &thread_token) {
+        if (! _mem_remote_fits(pool_mgr, alloc)) return ALLOC_FAIL;
+        _mem_push_remote_free(pool_mgr, alloc);
+        return ALLOC_OK;
+    }
+    if (pool_mgr->flags & POOL_THREAD_CACHE)
+        return _mem_cache_free(pool_mgr, alloc);
+
+    _mem_lock_pool(pool_mgr);
+    status = _mem_pool_free(pool_mgr, alloc);
+    _mem_unlock_pool(pool_mgr);
+
+    return status;
+}
+
+void * mem_realloc_alloc(pool_pt pool, void *alloc, size_t size) {
+    pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+    size_t old_size;
+    alloc_status status;
+
+    if (pool_mgr == NULL || size == 0) return NULL;
+    if (alloc == NULL) return mem_new_alloc(pool, size);
+
+    // in place first, under the lock of whichever pool holds the block
+    if (pool_mgr->num_shards > 0) {
+        pool_mgr_pt shard = _mem_shard_of(pool_mgr, alloc);
+        if (shard == NULL) return NULL;
+        _mem_lock(&shard->lock);
+        pool_t before = shard->pool;
+        old_size = _mem_alloc_size(shard, alloc);
+        status = (old_size == 0) ? ALLOC_FAIL
+                                 : _mem_realloc_in_place(shard, alloc, size);
+        _mem_shard_sum(pool_mgr, shard, &before);
+        _mem_unlock(&shard->lock);
+    } else {
+        if (pool_mgr->flags & POOL_REMOTE_FREE) {
+            // only the owner may touch a pool without a lock
+            if (pool_mgr->owner != &thread_token
+                && ! (pool_mgr->flags & POOL_THREAD_SAFE))
+                return NULL;
+            if (pool_mgr->owner == &thread_token)
+                _mem_drain_remote_frees(pool_mgr);
+            if (size < MEM_REMOTE_MIN_SIZE) size = MEM_REMOTE_MIN_SIZE;
+        }
+        _mem_lock_pool(pool_mgr);
+        // (a block a thread cache holds is not the user's to resize)
+        old_size = _mem_is_parked(pool_mgr, alloc)
+                   ? 0 : _mem_alloc_size(pool_mgr, alloc);
+        status = (old_size == 0) ? ALLOC_FAIL
+                                 : _mem_realloc_in_place(pool_mgr, alloc, size);
+        _mem_unlock_pool(pool_mgr);
+    }
+    if (old_size == 0) return NULL;
+    if (status == ALLOC_OK) return alloc;
+
+    // otherwise a new block, like any other allocation, and one straight
+    // copy of the contents before the old block goes
+    void *moved = mem_new_alloc(pool, size);
+    if (moved == NULL) return NULL;
+    memcpy(moved, alloc, (old_size < size) ? old_size : size);
+    mem_del_alloc(pool, alloc);
+
+    return moved;
+}
+
+alloc_status mem_new_alloc_batch(pool_pt pool,
+                                 const size_t *sizes,
+                                 size_t n,
+                                 void **out) {
+    pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+    alloc_status status = ALLOC_FAIL;
+    size_t min_size = 1;
+
+    if (pool_mgr == NULL || sizes == NULL || out == NULL) return ALLOC_FAIL;
+    if (n == 0) return ALLOC_OK;
+
+    if (pool_mgr->num_shards > 0) {
+        // the whole batch from one shard, the home shard first
+        unsigned home = _mem_home_shard(pool_mgr);
+        for (unsigned u = 0;
+             u < pool_mgr->num_shards && status != ALLOC_OK; u ++) {
+            pool_mgr_pt shard =
+                    pool_mgr->shards[(home + u) % pool_mgr->num_shards];
+            _mem_lock(&shard->lock);
+            pool_t before = shard->pool;
+            status = _mem_batch_alloc(shard, sizes, n, out, min_size);
+            if (status == ALLOC_OK) _mem_shard_sum(pool_mgr, shard, &before);
+            _mem_unlock(&shard->lock);
+        }
+        return status;
+    }
+    if (pool_mgr->flags & POOL_REMOTE_FREE) {
+        if (pool_mgr->owner == &thread_token) _mem_drain_remote_frees(pool_mgr);
+        min_size = MEM_REMOTE_MIN_SIZE;
+    }
+
+    // past the thread caches: the blocks are exactly the sizes asked for
+    _mem_lock_pool(pool_mgr);
+    if (pool_mgr->marked) {
+        status = _mem_resize_mark_log(pool_mgr, n);
+        if (status == ALLOC_OK)
+            status = _mem_batch_alloc(pool_mgr, sizes, n, out, min_size);
+        for (size_t i = 0; status == ALLOC_OK && i < n; i ++)
+            pool_mgr->mark_log[pool_mgr->mark_log_size ++] = out[i];
+    } else {
+        status = _mem_batch_alloc(pool_mgr, sizes, n, out, min_size);
+    }
+    _mem_unlock_pool(pool_mgr);
+
+    // the thread caches may be holding on to what the batch needs
+    if (status != ALLOC_OK && (pool_mgr->flags & POOL_THREAD_CACHE)) {
+        _mem_flush_caches(pool_mgr);
+        _mem_lock_pool(pool_mgr);
+        status = _mem_batch_alloc(pool_mgr, sizes, n, out, min_size);
+        _mem_unlock_pool(pool_mgr);
+    }
+
+    return status;
+}
+
+alloc_status mem_del_alloc_batch(pool_pt pool, void **allocs, size_t n) {
+    pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+    alloc_status status = ALLOC_OK;
+
+    if (pool_mgr == NULL || allocs == NULL) return ALLOC_FAIL;
+    if (n == 0) return ALLOC_OK;
+
+    if (pool_mgr->flags & POOL_REMOTE_FREE) {
+        if (pool_mgr->owner != &thread_token) {
+            for (size_t i = 0; i < n; i ++)
+                if (! _mem_remote_fits(pool_mgr, allocs[i]))
+                    return ALLOC_FAIL;
+            for (size_t i = 0; i < n; i ++)
+                _mem_push_remote_free(pool_mgr, allocs[i]);
+            return ALLOC_OK;
+        }
+        _mem_drain_remote_frees(pool_mgr);
+    }
+
+    // sorted by address, neighbours come one after the other
+    char **sorted = (char **) malloc(n * sizeof(char *));
+    if (sorted == NULL) {
+        perror("mem_del_alloc_batch");
+        return ALLOC_FAIL;
+    }
+    memcpy(sorted, allocs, n * sizeof(char *));
+    qsort(sorted, n, sizeof(char *), _mem_compare_allocs);
+
+    // past the thread caches, like mem_new_alloc_batch
+    _mem_lock_pool(pool_mgr);
+
+    // all or nothing: check the whole batch before freeing any of it
+    for (size_t i = 0; i < n && status == ALLOC_OK; i ++) {
+        pool_mgr_pt owner = (pool_mgr->num_shards > 0)
+                            ? _mem_shard_of(pool_mgr, sorted[i]) : pool_mgr;
+        if ((i > 0 && sorted[i] == sorted[i - 1]) || owner == NULL
+            || _mem_alloc_size(owner, sorted[i]) == 0
+            || _mem_is_parked(owner, sorted[i]))
+            status = ALLOC_FAIL;
+    }
+
+    if (status == ALLOC_OK && pool_mgr->num_shards == 0)
+        status = _mem_batch_free(pool_mgr, sorted, n);
+
+    // the shards hold address ranges in order, so each gets a run of its own
+    // (all the locks are held, so the sum is done here)
+    size_t i = 0;
+    while (status == ALLOC_OK && pool_mgr->num_shards > 0 && i < n) {
+        pool_mgr_pt shard = _mem_shard_of(pool_mgr, sorted[i]);
+        size_t j = i + 1;
+        while (j < n && _mem_shard_of(pool_mgr, sorted[j]) == shard) j ++;
+        pool_t before = shard->pool;
+        status = _mem_batch_free(shard, sorted + i, j - i);
+        pool->alloc_size += shard->pool.alloc_size - before.alloc_size;
+        pool->num_allocs += shard->pool.num_allocs - before.num_allocs;
+        pool->num_gaps += shard->pool.num_gaps - before.num_gaps;
+        i = j;
+    }
+
+    _mem_unlock_pool(pool_mgr);
+    free(sorted);
+
+    return status;
+}
+
+alloc_status mem_pool_reset(pool_pt pool) {
+    pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+    alloc_status status = ALLOC_OK;
+
+    if (pool_mgr == NULL) return ALLOC_FAIL;
+
+    _mem_drop_parked(pool_mgr);
+    _mem_lock_pool(pool_mgr);
+    if (pool_mgr->num_shards == 0) {
+        status = _mem_pool_reset(pool_mgr);
+    } else {
+        pool->num_allocs = 0;
+        pool->alloc_size = 0;
+        pool->num_gaps = 0;
+        for (unsigned u = 0; u < pool_mgr->num_shards; u ++) {
+            if (_mem_pool_reset(pool_mgr->shards[u]) != ALLOC_OK)
+                status = ALLOC_FAIL;
+            pool->num_gaps += pool_mgr->shards[u]->pool.num_gaps;
+        }
+    }
+    _mem_unlock_pool(pool_mgr);
+
+    return status;
+}
+
+pool_mark_t mem_pool_mark(pool_pt pool) {
+    pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+    pool_mark_t mark = {MEM_MARK_NONE, 0, 0};
+
+    // the thread caches and the shards allocate past the log
+    if (pool_mgr == NULL || (pool_mgr->flags & POOL_THREAD_CACHE)
+        || pool_mgr->num_shards > 0)
+        return mark;
+
+    _mem_lock_pool(pool_mgr);
+    if (_mem_resize_mark_stack(pool_mgr) == ALLOC_OK) {
+        pool_mgr->marked = 1;
+        mark.depth = pool_mgr->mark_log_size;
+        mark.epoch = pool_mgr->mark_epoch;
+        mark.level = pool_mgr->num_marks;
+        pool_mgr->mark_stack[pool_mgr->num_marks ++] = mark.depth;
+    }
+    _mem_unlock_pool(pool_mgr);
+
+    return mark;
+}
+
+alloc_status mem_pool_release_to_mark(pool_pt pool, pool_mark_t mark) {
+    pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+    alloc_status status;
+
+    if (pool_mgr == NULL || mark.depth == MEM_MARK_NONE) return ALLOC_FAIL;
+
+    // the queued deallocations first, their blocks are not held any more
+    _mem_flush_parked(pool_mgr);
+    _mem_lock_pool(pool_mgr);
+    if (! _mem_mark_is_valid(pool_mgr, mark)) {
+        status = ALLOC_FAIL;
+    } else {
+        // the mark stays, the ones after it go
+        status = _mem_release_mark_log(pool_mgr, mark.depth);
+        pool_mgr->num_marks = mark.level + 1;
+    }
+    _mem_unlock_pool(pool_mgr);
 
-    return ALLOC_FAIL;
+    return status;
+}
+
+alloc_status mem_pool_commit_mark(pool_pt pool, pool_mark_t mark) {
+    pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+    alloc_status status = ALLOC_OK;
+
+    if (pool_mgr == NULL || mark.depth == MEM_MARK_NONE) return ALLOC_FAIL;
+
+    _mem_lock_pool(pool_mgr);
+    if (! _mem_mark_is_valid(pool_mgr, mark)) {
+        status = ALLOC_FAIL;
+    } else {
+        // the allocations since the mark belong to the mark before it, and
+        // the marks after it go
+        pool_mgr->num_marks = mark.level;
+        if (pool_mgr->num_marks == 0) {
+            // nothing to release to any more, so nothing to log
+            pool_mgr->marked = 0;
+            pool_mgr->mark_log_size = 0;
+            pool_mgr->mark_epoch ++;
+        }
+    }
+    _mem_unlock_pool(pool_mgr);
+
+    return status;
 }
 
 void mem_inspect_pool(pool_pt pool,
                       pool_segment_pt *segments,
                       unsigned *num_segments) {
     // get the mgr from the pool
-    // allocate the segments array with size == used_nodes
+    pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+
+    // allocate the segments array with size == allocs + gaps
+    // (the blocks in the thread caches are gaps)
+    _mem_flush_parked(pool_mgr);
+    _mem_lock_pool(pool_mgr);
+    unsigned num = pool->num_allocs + pool->num_gaps;
+    pool_segment_pt segs =
+            (pool_segment_pt) calloc(num, sizeof(pool_segment_t));
     // check successful
-    // loop through the node heap and the segments array
-    //    for each node, write the size and allocated in the segment
+    if (segs == NULL) {
+        _mem_unlock_pool(pool_mgr);
+        perror("mem_inspect_pool");
+        return;
+    }
+
+    // loop through the segments and the segments array
+    //    for each segment, write the size and allocated
+    pool_cursor_t cursor = {0, 0};
+    for (unsigned u = 0; u < num && cursor.offset < pool->total_size; u ++)
+        _mem_next_segment(pool_mgr, &cursor, &segs[u]);
+    _mem_unlock_pool(pool_mgr);
+
     // "return" the values:
-    /*
-                    *segments = segs;
-                    *num_segments = pool_mgr->used_nodes;
-     */
+    *segments = segs;
+    *num_segments = num;
+}
+
+alloc_status mem_pool_foreach_segment(pool_pt pool,
+                                      pool_segment_visitor visitor,
+                                      void *ctx) {
+    pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+    alloc_status status;
+
+    _mem_flush_parked(pool_mgr);
+    _mem_lock_pool(pool_mgr);
+    status = _mem_foreach_segment(pool_mgr, visitor, ctx);
+    _mem_unlock_pool(pool_mgr);
+
+    return status;
+}
+
+alloc_status mem_inspect_pool_slice(pool_pt pool,
+                                    pool_cursor_pt cursor,
+                                    pool_segment_pt segments,
+                                    unsigned capacity,
+                                    unsigned *num_segments) {
+    pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+    alloc_status status = ALLOC_OK;
+    unsigned u = 0;
+
+    *num_segments = 0;
+    _mem_flush_parked(pool_mgr);
+    _mem_lock_pool(pool_mgr);
+    while (u < capacity && cursor->offset < pool->total_size) {
+        status = _mem_next_segment(pool_mgr, cursor, &segments[u]);
+        if (status != ALLOC_OK) break;
+        *num_segments = ++ u;
+    }
+    _mem_unlock_pool(pool_mgr);
+
+    return status;
+}
+
+alloc_status mem_pool_stats(pool_pt pool, pool_stats_pt stats) {
+    pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+
+    if (pool_mgr == NULL || stats == NULL) return ALLOC_FAIL;
+
+    _mem_flush_parked(pool_mgr);
+    _mem_lock_pool(pool_mgr);
+    stats->free_size = pool->total_size - pool->alloc_size;
+    stats->small_gap_threshold = pool_mgr->small_gap_threshold;
+    stats->small_gap_size = pool_mgr->small_gap_size;
+    for (unsigned u = 0; u < pool_mgr->num_shards; u ++)
+        stats->small_gap_size += pool_mgr->shards[u]->small_gap_size;
+    _mem_gap_extremes(pool_mgr, &stats->smallest_gap, &stats->largest_gap);
+
+    // a slab pool has one gap size, so its small gaps are simply counted
+    if (pool->policy == SLAB)
+        stats->small_gap_size =
+                (pool_mgr->slab_block < pool_mgr->small_gap_threshold)
+                ? pool->num_gaps * pool_mgr->slab_block : 0;
+    _mem_unlock_pool(pool_mgr);
+
+    // external fragmentation: the share of free memory outside the largest gap
+    stats->fragmentation =
+            (stats->free_size == 0)
+            ? 0.0 : 1.0 - (double) stats->largest_gap / stats->free_size;
+
+    return ALLOC_OK;
+}
+
+alloc_status mem_pool_track_small_gaps(pool_pt pool, size_t threshold) {
+    pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+
+    if (pool_mgr == NULL) return ALLOC_FAIL;
+
+    // count the gaps below the new threshold once, then keep count
+    _mem_flush_parked(pool_mgr);
+    _mem_lock_pool(pool_mgr);
+    pool_mgr->small_gap_threshold = threshold;
+    pool_mgr->small_gap_size = 0;
+    alloc_status status = (pool->policy == SLAB || pool_mgr->num_shards > 0)
+            ? ALLOC_OK
+            : _mem_foreach_segment(pool_mgr, _mem_count_small_gap, pool_mgr);
+    // the shards of a sharded pool keep count each
+    for (unsigned u = 0; u < pool_mgr->num_shards; u ++) {
+        pool_mgr_pt shard = pool_mgr->shards[u];
+        shard->small_gap_threshold = threshold;
+        shard->small_gap_size = 0;
+        if (_mem_foreach_segment(shard, _mem_count_small_gap, shard)
+            != ALLOC_OK)
+            status = ALLOC_FAIL;
+    }
+    _mem_unlock_pool(pool_mgr);
+
+    return status;
+}
+
+alloc_status mem_pool_flush_caches(pool_pt pool) {
+    pool_mgr_pt pool_mgr = (pool_mgr_pt) pool;
+
+    if (pool_mgr == NULL) return ALLOC_FAIL;
+    _mem_flush_parked(pool_mgr);
+
+    // the deferred deallocations that turned out bad are reported here
+    _mem_lock_pool(pool_mgr);
+    unsigned long late_fails = pool_mgr->late_fails;
+    pool_mgr->late_fails = 0;
+    _mem_unlock_pool(pool_mgr);
+
+    return (late_fails > 0) ? ALLOC_FAIL : ALLOC_OK;
 }
 
 
@@ -256,66 +1120,2454 @@ void mem_inspect_pool(pool_pt pool,
 /***********************************/
 static alloc_status _mem_resize_pool_store() {
     // check if necessary
-    /*
-                if (((float) pool_store_size / pool_store_capacity)
-                    > MEM_POOL_STORE_FILL_FACTOR) {...}
-     */
-    // don't forget to update capacity variables
+    if (((float) pool_store_size / pool_store_capacity)
+        > MEM_POOL_STORE_FILL_FACTOR) {
+        if (pool_store_chunks == MEM_POOL_STORE_CHUNKS
+            || pool_store_capacity > UINT_MAX / MEM_POOL_STORE_EXPAND_FACTOR)
+            return ALLOC_FAIL;
+        unsigned capacity =
+                pool_store_capacity * MEM_POOL_STORE_EXPAND_FACTOR;
+
+        // add a chunk for the new pointers, the old ones stay where they
+        // are for whoever is looking at them
+        pool_slot_pt chunk =
+                (pool_slot_pt) calloc(capacity - pool_store_capacity,
+                                      sizeof(pool_slot_t));
+        if (chunk == NULL) {
+            perror("_mem_resize_pool_store");
+            return ALLOC_FAIL;
+        }
+
+        // don't forget to update capacity variables
+        pool_store[pool_store_chunks ++] = chunk;
+        pool_store_capacity = capacity;
+    }
+
+    return ALLOC_OK;
+}
+
+static pool_slot_pt _mem_store_slot(unsigned ix) {
+    unsigned quot = ix / MEM_POOL_STORE_INIT_CAPACITY;
+
+    if (quot == 0) return &pool_store[0][ix];
+
+    unsigned chunk = _mem_msb(quot) + 1;
+    return &pool_store[chunk]
+            [ix - (MEM_POOL_STORE_INIT_CAPACITY << (chunk - 1))];
+}
+
+static pool_mgr_pt _mem_pool_create(size_t size,
+                                    alloc_policy policy,
+                                    unsigned flags,
+                                    char *mem) {
+    // allocate a new mem pool mgr
+    pool_mgr_pt pool_mgr = (pool_mgr_pt) calloc(1, sizeof(pool_mgr_t));
+    // check success, on error return null
+    if (pool_mgr == NULL) {
+        perror("_mem_pool_create");
+        return NULL;
+    }
+
+    // allocate a new memory pool, unless it is a shard of one
+    pool_mgr->pool.mem = (mem != NULL) ? mem : (char *) malloc(size);
+    // check success, on error deallocate mgr and return null
+    if (pool_mgr->pool.mem == NULL) {
+        perror("_mem_pool_create");
+        free(pool_mgr);
+        return NULL;
+    }
+
+    // a buddy pool needs no node heap or gap index
+    if (policy == BUDDY) {
+        pool_mgr->flags = flags;
+        pool_mgr->pool.policy = policy;
+        pool_mgr->pool.total_size = size;
+        if (_mem_buddy_init(pool_mgr) != ALLOC_OK) {
+            if (mem == NULL) free(pool_mgr->pool.mem);
+            free(pool_mgr);
+            return NULL;
+        }
+        return pool_mgr;
+    }
+
+    // allocate a new node heap
+    pool_mgr->node_heap[0] =
+            (node_pt) calloc(MEM_NODE_HEAP_INIT_CAPACITY, sizeof(node_t));
+    // check success, on error deallocate mgr/pool and return null
+    if (pool_mgr->node_heap[0] == NULL) {
+        perror("_mem_pool_create");
+        if (mem == NULL) free(pool_mgr->pool.mem);
+        free(pool_mgr);
+        return NULL;
+    }
+
+    // allocate a new gap index
+    pool_mgr->gap_ix =
+            (gap_pt) calloc(MEM_GAP_IX_INIT_CAPACITY, sizeof(gap_t));
+    // check success, on error deallocate mgr/pool/heap and return null
+    if (pool_mgr->gap_ix == NULL) {
+        perror("_mem_pool_create");
+        free(pool_mgr->node_heap[0]);
+        if (mem == NULL) free(pool_mgr->pool.mem);
+        free(pool_mgr);
+        return NULL;
+    }
+
+    // allocate a new allocation index
+    pool_mgr->alloc_ix =
+            (unsigned *) calloc(MEM_ALLOC_IX_INIT_CAPACITY, sizeof(unsigned));
+    // check success, on error deallocate mgr/pool/heap/gaps and return null
+    if (pool_mgr->alloc_ix == NULL) {
+        perror("_mem_pool_create");
+        free(pool_mgr->gap_ix);
+        free(pool_mgr->node_heap[0]);
+        if (mem == NULL) free(pool_mgr->pool.mem);
+        free(pool_mgr);
+        return NULL;
+    }
+
+    // assign all the pointers and update meta data:
+    //   the allocation index starts empty
+    for (unsigned u = 0; u < MEM_ALLOC_IX_INIT_CAPACITY; u ++)
+        pool_mgr->alloc_ix[u] = MEM_NODE_NIL;
+    //   initialize top node of node heap
+    pool_mgr->node_heap[0][0].offset = 0;
+    pool_mgr->node_heap[0][0].size = size;
+    pool_mgr->node_heap[0][0].used = 1;
+    pool_mgr->node_heap[0][0].allocated = 0;
+    pool_mgr->node_heap[0][0].next = MEM_NODE_NIL;
+    pool_mgr->node_heap[0][0].prev = MEM_NODE_NIL;
+    //   the rest are handed out in order first, so there is no list to build
+    pool_mgr->unused_nodes = MEM_NODE_NIL;
+    pool_mgr->fresh_node = 1;
+
+    //   initialize pool mgr
+    pool_mgr->flags = flags;
+    if (policy == FIRST_FIT || policy == NEXT_FIT)
+        pool_mgr->gap_ix_kind = GAP_IX_ADDR_TREE;
+    else if (policy == TLSF)
+        pool_mgr->gap_ix_kind = GAP_IX_TLSF;
+    else if (flags & POOL_GAP_TREE)
+        pool_mgr->gap_ix_kind = GAP_IX_SIZE_TREE;
+    else
+        pool_mgr->gap_ix_kind = GAP_IX_CLASSES;
+    pool_mgr->pool.policy = policy;
+    pool_mgr->pool.total_size = size;
+    pool_mgr->pool.alloc_size = 0;
+    pool_mgr->pool.num_allocs = 0;
+    pool_mgr->pool.num_gaps = 0;
+    pool_mgr->node_chunks = 1;
+    pool_mgr->total_nodes = MEM_NODE_HEAP_INIT_CAPACITY;
+    pool_mgr->used_nodes = 1;
+    pool_mgr->rover = 0;
+    pool_mgr->alloc_ix_capacity = MEM_ALLOC_IX_INIT_CAPACITY;
+    pool_mgr->gap_ix_capacity = MEM_GAP_IX_INIT_CAPACITY;
+    pool_mgr->gap_offset_bits = (size > 0) ? _mem_msb(size) + 1 : 1;
+    _mem_invalidate_gap_ix(pool_mgr);
+
+    //   initialize top node of gap index
+    if (_mem_add_to_gap_ix(pool_mgr, size, 0) != ALLOC_OK) {
+        free(pool_mgr->alloc_ix);
+        free(pool_mgr->gap_ix);
+        free(pool_mgr->node_heap[0]);
+        if (mem == NULL) free(pool_mgr->pool.mem);
+        free(pool_mgr);
+        return NULL;
+    }
+
+    return pool_mgr;
+}
+
+static alloc_status _mem_store_pool(pool_mgr_pt pool_mgr) {
+    alloc_status status;
 
-    return ALLOC_FAIL;
+    // pools are added one at a time, each counted once it is in its slot
+    _mem_lock(&pool_store_lock);
+    status = _mem_resize_pool_store();
+    if (status == ALLOC_OK) {
+        unsigned ix = atomic_load_explicit(&pool_store_size,
+                                           memory_order_relaxed);
+        pool_mgr->serial = ++ pool_serial;
+        atomic_store_explicit(_mem_store_slot(ix), pool_mgr,
+                              memory_order_relaxed);
+        atomic_store_explicit(&pool_store_size, ix + 1, memory_order_release);
+    }
+    _mem_unlock(&pool_store_lock);
+
+    return status;
+}
+
+static void _mem_free_pool(pool_mgr_pt pool_mgr) {
+    // free shards, then the memory pool they are parts of
+    for (unsigned u = 0; u < pool_mgr->num_shards; u ++)
+        if (pool_mgr->shards[u] != NULL) _mem_free_pool(pool_mgr->shards[u]);
+    free(pool_mgr->shards);
+    if (pool_mgr->parent == NULL) free(pool_mgr->pool.mem);
+    free(pool_mgr->buddy_map);
+    free(pool_mgr->buddy_parked);
+    free(pool_mgr->slab_map);
+    // free node heap, chunk by chunk
+    for (unsigned u = 0; u < pool_mgr->node_chunks; u ++)
+        free(pool_mgr->node_heap[u]);
+    // free gap index
+    free(pool_mgr->gap_ix);
+    // free allocation index
+    free(pool_mgr->alloc_ix);
+    // free the log of the marks and their stack
+    free(pool_mgr->mark_log);
+    free(pool_mgr->mark_stack);
+    // free thread caches (the other threads notice by the pool serial)
+    while (pool_mgr->caches != NULL) {
+        mem_cache_pt cache = pool_mgr->caches;
+        pool_mgr->caches = cache->next;
+        free(cache);
+    }
+
+    // free mgr
+    free(pool_mgr);
+}
+
+static void _mem_lock(mem_lock_pt lock) {
+    // spin on a plain load, so waiting threads don't steal the line
+    // from each other, and try to take the lock only when it looks free
+    while (atomic_exchange_explicit(&lock->held, 1, memory_order_acquire))
+        while (atomic_load_explicit(&lock->held, memory_order_relaxed)) {
+#ifdef MEM_PAUSE_X86
+            _mm_pause();
+#endif
+        }
 }
 
-static alloc_status _mem_resize_node_heap(pool_mgr_pt pool_mgr) {
-    // see above
+static void _mem_unlock(mem_lock_pt lock) {
+    atomic_store_explicit(&lock->held, 0, memory_order_release);
+}
+
+// note: a sharded pool as a whole is locked shard by shard, in address
+// order, before its own lock
+static void _mem_lock_pool(pool_mgr_pt pool_mgr) {
+    for (unsigned u = 0; u < pool_mgr->num_shards; u ++)
+        _mem_lock(&pool_mgr->shards[u]->lock);
+    if (pool_mgr->flags & POOL_THREAD_SAFE) _mem_lock(&pool_mgr->lock);
+}
+
+static void _mem_unlock_pool(pool_mgr_pt pool_mgr) {
+    if (pool_mgr->flags & POOL_THREAD_SAFE) _mem_unlock(&pool_mgr->lock);
+    for (unsigned u = pool_mgr->num_shards; u > 0; u --)
+        _mem_unlock(&pool_mgr->shards[u - 1]->lock);
+}
+
+// note: makes room for extra more nodes than are used, a chunk at a time
+static alloc_status _mem_resize_node_heap(pool_mgr_pt pool_mgr,
+                                          unsigned extra) {
+    while (((float) (pool_mgr->used_nodes + extra) / pool_mgr->total_nodes)
+           > MEM_NODE_HEAP_FILL_FACTOR) {
+        if (pool_mgr->node_chunks == MEM_NODE_HEAP_CHUNKS
+            || pool_mgr->total_nodes > UINT_MAX / MEM_NODE_HEAP_EXPAND_FACTOR)
+            return ALLOC_FAIL;
+        unsigned capacity =
+                pool_mgr->total_nodes * MEM_NODE_HEAP_EXPAND_FACTOR;
+
+        // add a chunk for the new nodes, the old ones stay where they are,
+        // so the list, the rover and both indexes need no fixing up
+        // (the new nodes are handed out after the fresh ones below them)
+        unsigned count = capacity - pool_mgr->total_nodes;
+        node_pt chunk = (node_pt) calloc(count, sizeof(node_t));
+        if (chunk == NULL) {
+            perror("_mem_resize_node_heap");
+            return ALLOC_FAIL;
+        }
+
+        pool_mgr->node_heap[pool_mgr->node_chunks ++] = chunk;
+        pool_mgr->total_nodes = capacity;
+    }
 
-    return ALLOC_FAIL;
+    return ALLOC_OK;
 }
 
 static alloc_status _mem_resize_gap_ix(pool_mgr_pt pool_mgr) {
-    // see above
+    if (((float) pool_mgr->pool.num_gaps / pool_mgr->gap_ix_capacity)
+        > MEM_GAP_IX_FILL_FACTOR) {
+        // a node has no room for larger slots
+        if (pool_mgr->gap_ix_capacity
+            > MEM_NODE_GAP_NIL / MEM_GAP_IX_EXPAND_FACTOR)
+            return ALLOC_FAIL;
+        unsigned capacity =
+                pool_mgr->gap_ix_capacity * MEM_GAP_IX_EXPAND_FACTOR;
+        gap_pt gap_ix =
+                (gap_pt) realloc(pool_mgr->gap_ix, capacity * sizeof(gap_t));
+        if (gap_ix == NULL) {
+            perror("_mem_resize_gap_ix");
+            return ALLOC_FAIL;
+        }
+
+        // the new slots go on the free slot list
+        for (unsigned u = pool_mgr->gap_ix_capacity; u < capacity; u ++) {
+            gap_ix[u].size = 0;
+            gap_ix[u].node = MEM_NODE_NIL;
+            gap_ix[u].next = (u + 1 < capacity) ? u + 1 : pool_mgr->gap_ix_free;
+            gap_ix[u].prev = MEM_GAP_NIL;
+            gap_ix[u].up = MEM_GAP_NIL;
+            gap_ix[u].height = 0;
+        }
+        pool_mgr->gap_ix_free = pool_mgr->gap_ix_capacity;
+
+        pool_mgr->gap_ix = gap_ix;
+        pool_mgr->gap_ix_capacity = capacity;
+    }
+
+    return ALLOC_OK;
+}
+
+// note: chunk 0 holds the first MEM_NODE_HEAP_INIT_CAPACITY nodes and every
+// later chunk doubles the total, so chunk k > 0 starts at INIT << (k - 1)
+static node_pt _mem_node(pool_mgr_pt pool_mgr, unsigned ix) {
+    unsigned quot = ix / MEM_NODE_HEAP_INIT_CAPACITY;
+
+    if (quot == 0) return &pool_mgr->node_heap[0][ix];
+
+    unsigned chunk = _mem_msb(quot) + 1;
+    return &pool_mgr->node_heap[chunk]
+            [ix - (MEM_NODE_HEAP_INIT_CAPACITY << (chunk - 1))];
+}
+
+// note: reuses the node freed last, or hands out the next fresh one
+static unsigned _mem_get_unused_node(pool_mgr_pt pool_mgr) {
+    unsigned ix = pool_mgr->unused_nodes;
+
+    if (ix != MEM_NODE_NIL) {
+        pool_mgr->unused_nodes = _mem_node(pool_mgr, ix)->next;
+    } else if (pool_mgr->fresh_node < pool_mgr->total_nodes) {
+        ix = pool_mgr->fresh_node ++;
+    } else {
+        return MEM_NODE_NIL;
+    }
+    _mem_node(pool_mgr, ix)->next = MEM_NODE_NIL;
+    // (a fresh node may still be flagged from before a reset)
+    atomic_store_explicit(&_mem_node(pool_mgr, ix)->parked, 0,
+                          memory_order_relaxed);
+
+    return ix;
+}
+
+static void _mem_put_unused_node(pool_mgr_pt pool_mgr, unsigned ix) {
+    _mem_node(pool_mgr, ix)->next = pool_mgr->unused_nodes;
+    pool_mgr->unused_nodes = ix;
+}
+
+// note: makes room for extra more allocations than there are
+static alloc_status _mem_resize_alloc_ix(pool_mgr_pt pool_mgr,
+                                         unsigned extra) {
+    while (((float) (pool_mgr->pool.num_allocs + extra)
+            / pool_mgr->alloc_ix_capacity)
+           > MEM_ALLOC_IX_FILL_FACTOR) {
+        unsigned *old_ix = pool_mgr->alloc_ix;
+        unsigned old_capacity = pool_mgr->alloc_ix_capacity;
+        unsigned capacity = old_capacity * MEM_ALLOC_IX_EXPAND_FACTOR;
+        unsigned *alloc_ix = (unsigned *) calloc(capacity, sizeof(unsigned));
+        if (alloc_ix == NULL) {
+            perror("_mem_resize_alloc_ix");
+            return ALLOC_FAIL;
+        }
+        for (unsigned u = 0; u < capacity; u ++)
+            alloc_ix[u] = MEM_NODE_NIL;
+
+        // rehash into the larger table
+        pool_mgr->alloc_ix = alloc_ix;
+        pool_mgr->alloc_ix_capacity = capacity;
+        for (unsigned u = 0; u < old_capacity; u ++)
+            if (old_ix[u] != MEM_NODE_NIL)
+                _mem_add_to_alloc_ix(pool_mgr, old_ix[u]);
+        free(old_ix);
+    }
 
-    return ALLOC_FAIL;
+    return ALLOC_OK;
+}
+
+// note: never fails, the caller has made room with _mem_resize_alloc_ix
+static void _mem_add_to_alloc_ix(pool_mgr_pt pool_mgr, unsigned node) {
+    unsigned mask = pool_mgr->alloc_ix_capacity - 1;
+    unsigned ix = _mem_hash_alloc_ix(pool_mgr,
+                                     _mem_node(pool_mgr, node)->offset);
+
+    while (pool_mgr->alloc_ix[ix] != MEM_NODE_NIL) ix = (ix + 1) & mask;
+    pool_mgr->alloc_ix[ix] = node;
+}
+
+// note: shifts the rest of the probe run back, so lookups need no tombstones
+static void _mem_remove_from_alloc_ix(pool_mgr_pt pool_mgr, unsigned node) {
+    unsigned *alloc_ix = pool_mgr->alloc_ix;
+    unsigned mask = pool_mgr->alloc_ix_capacity - 1;
+    unsigned hole = _mem_find_in_alloc_ix(pool_mgr,
+                                          _mem_node(pool_mgr, node)->offset);
+
+    if (hole == MEM_ALLOC_IX_NIL) return;
+    alloc_ix[hole] = MEM_NODE_NIL;
+
+    for (unsigned ix = (hole + 1) & mask;
+         alloc_ix[ix] != MEM_NODE_NIL;
+         ix = (ix + 1) & mask) {
+        unsigned home = _mem_hash_alloc_ix(pool_mgr,
+                                           _mem_node(pool_mgr,
+                                                     alloc_ix[ix])->offset);
+        // move it into the hole, unless its home lies between the two
+        if (((ix - home) & mask) >= ((ix - hole) & mask)) {
+            alloc_ix[hole] = alloc_ix[ix];
+            alloc_ix[ix] = MEM_NODE_NIL;
+            hole = ix;
+        }
+    }
+}
+
+static unsigned _mem_find_in_alloc_ix(pool_mgr_pt pool_mgr, size_t offset) {
+    unsigned mask = pool_mgr->alloc_ix_capacity - 1;
+    unsigned ix = _mem_hash_alloc_ix(pool_mgr, offset);
+
+    while (pool_mgr->alloc_ix[ix] != MEM_NODE_NIL) {
+        if (_mem_node(pool_mgr, pool_mgr->alloc_ix[ix])->offset == offset)
+            return ix;
+        ix = (ix + 1) & mask;
+    }
+
+    return MEM_ALLOC_IX_NIL;
+}
+
+static unsigned _mem_hash_alloc_ix(pool_mgr_pt pool_mgr, size_t offset) {
+    // fibonacci hashing, the top bits are the well-mixed ones
+    uint64_t hash = (uint64_t) offset * 0x9e3779b97f4a7c15u;
+
+    return (unsigned) (hash >> (64 - _mem_msb(pool_mgr->alloc_ix_capacity)));
 }
 
 static alloc_status _mem_add_to_gap_ix(pool_mgr_pt pool_mgr,
                                        size_t size,
-                                       node_pt node) {
+                                       unsigned node) {
 
     // expand the gap index, if necessary (call the function)
-    // add the entry at the end
-    // update metadata (num_gaps)
-    // sort the gap index (call the function)
-    // check success
+    if (_mem_resize_gap_ix(pool_mgr) != ALLOC_OK) return ALLOC_FAIL;
+    if (pool_mgr->gap_ix_free == MEM_GAP_NIL) return ALLOC_FAIL;
+
+    // take a free slot for the entry
+    unsigned slot = pool_mgr->gap_ix_free;
+    gap_pt gap = &pool_mgr->gap_ix[slot];
+    pool_mgr->gap_ix_free = gap->next;
+    gap->size = size;
+    gap->node = node;
+    _mem_node(pool_mgr, node)->gap = slot;
 
-    return ALLOC_FAIL;
+    // update metadata (num_gaps, small gaps)
+    pool_mgr->pool.num_gaps ++;
+    if (size < pool_mgr->small_gap_threshold) pool_mgr->small_gap_size += size;
+
+    // put it in its size class trie, or the gap tree
+    if (pool_mgr->gap_ix_kind == GAP_IX_CLASSES
+        || pool_mgr->gap_ix_kind == GAP_IX_TLSF)
+        _mem_insert_class_trie(pool_mgr, slot);
+    else
+        pool_mgr->gap_root =
+                _mem_insert_gap_tree(pool_mgr, pool_mgr->gap_root, slot);
+
+    return ALLOC_OK;
 }
 
 static alloc_status _mem_remove_from_gap_ix(pool_mgr_pt pool_mgr,
                                             size_t size,
-                                            node_pt node) {
+                                            unsigned node) {
     // find the position of the node in the gap index
-    // loop from there to the end of the array:
-    //    pull the entries (i.e. copy over) one position up
-    //    this effectively deletes the chosen node
-    // update metadata (num_gaps)
-    // zero out the element at position num_gaps!
+    unsigned slot = _mem_node(pool_mgr, node)->gap;
+    if (slot >= pool_mgr->gap_ix_capacity) return ALLOC_FAIL;
+    gap_pt gap = &pool_mgr->gap_ix[slot];
+    if (gap->node != node || gap->size != size) return ALLOC_FAIL;
+
+    // take it out of its size class trie, or the gap tree
+    if (pool_mgr->gap_ix_kind == GAP_IX_CLASSES
+        || pool_mgr->gap_ix_kind == GAP_IX_TLSF)
+        _mem_remove_class_trie(pool_mgr, slot);
+    else
+        pool_mgr->gap_root =
+                _mem_remove_gap_tree(pool_mgr, pool_mgr->gap_root, slot);
+
+    // update metadata (num_gaps, small gaps)
+    pool_mgr->pool.num_gaps --;
+    if (size < pool_mgr->small_gap_threshold) pool_mgr->small_gap_size -= size;
 
-    return ALLOC_FAIL;
+    // zero out the entry and return the slot to the free slot list
+    gap->size = 0;
+    gap->node = MEM_NODE_NIL;
+    gap->height = 0;
+    gap->up = MEM_GAP_NIL;
+    gap->prev = MEM_GAP_NIL;
+    gap->next = pool_mgr->gap_ix_free;
+    pool_mgr->gap_ix_free = slot;
+    _mem_node(pool_mgr, node)->gap = MEM_NODE_GAP_NIL;
+
+    return ALLOC_OK;
 }
 
-// note: only called by _mem_add_to_gap_ix, which appends a single entry
-static alloc_status _mem_sort_gap_ix(pool_mgr_pt pool_mgr) {
-    // the new entry is at the end, so "bubble it up"
-    // loop from num_gaps - 1 until but not including 0:
-    //    if the size of the current entry is less than the previous (u - 1)
-    //    or if the sizes are the same but the current entry points to a
-    //    node with a lower address of pool allocation address (mem)
-    //       swap them (by copying) (remember to use a temporary variable)
+// note: a class trie yields its least entry of at least (size, 0), the best
+// fit, ties going to the lower address; every entry of a higher class is
+// larger than any entry below it, so failing that the least entry of the
+// next non-empty class is the best fit
+static unsigned _mem_find_in_gap_ix(pool_mgr_pt pool_mgr, size_t size) {
+    if (pool_mgr->gap_ix_kind == GAP_IX_SIZE_TREE) {
+        // the leftmost sufficient entry of the tree is the best fit
+        unsigned best = MEM_GAP_NIL;
+        unsigned slot = pool_mgr->gap_root;
+        while (slot != MEM_GAP_NIL) {
+            if (pool_mgr->gap_ix[slot].size >= size) {
+                best = slot;
+                slot = pool_mgr->gap_ix[slot].left;
+            } else {
+                slot = pool_mgr->gap_ix[slot].right;
+            }
+        }
+        return (best == MEM_GAP_NIL) ? MEM_NODE_NIL
+                                     : pool_mgr->gap_ix[best].node;
+    }
+
+    if (size > (mem_off_t) -1) return MEM_NODE_NIL;
+    unsigned size_class = _mem_gap_class(size);
 
-    return ALLOC_FAIL;
+    unsigned best = _mem_bound_class_trie(pool_mgr, size_class, size);
+    if (best == MEM_GAP_NIL && size_class + 1 < MEM_GAP_NUM_CLASSES) {
+        size_class = _mem_next_gap_class(pool_mgr, size_class + 1);
+        if (size_class != MEM_GAP_NIL)
+            best = _mem_class_trie_end(pool_mgr,
+                                       pool_mgr->gap_class[size_class], 0);
+    }
+
+    return (best == MEM_GAP_NIL) ? MEM_NODE_NIL : pool_mgr->gap_ix[best].node;
 }
 
-static alloc_status _mem_invalidate_gap_ix(pool_mgr_pt pool_mgr) {
-    return ALLOC_FAIL;
+// note: only for GAP_IX_TLSF, rounds the size up to the next class boundary,
+// so that every gap of that class or above fits, and takes the least entry
+// of the first non-empty one, in one walk of its trie; failing that, a gap
+// of the requested class itself may still be large enough
+static unsigned _mem_find_good_in_gap_ix(pool_mgr_pt pool_mgr, size_t size) {
+    if (size > (mem_off_t) -1) return MEM_NODE_NIL;
+    size_t rounded = size;
+    if (size >= MEM_GAP_CLASS_SUBS) {
+        size_t step = (size_t) 1 << (_mem_msb(size) - MEM_GAP_CLASS_SUB_BITS);
+        rounded = (size + (step - 1) < size) ? SIZE_MAX : size + (step - 1);
+    }
+
+    unsigned slot = MEM_GAP_NIL;
+    if (rounded <= (mem_off_t) -1) {
+        unsigned size_class =
+                _mem_next_gap_class(pool_mgr, _mem_gap_class(rounded));
+        if (size_class != MEM_GAP_NIL)
+            slot = _mem_class_trie_end(pool_mgr,
+                                       pool_mgr->gap_class[size_class], 0);
+    }
+    if (slot == MEM_GAP_NIL)
+        slot = _mem_bound_class_trie(pool_mgr, _mem_gap_class(size), size);
+
+    return (slot == MEM_GAP_NIL) ? MEM_NODE_NIL : pool_mgr->gap_ix[slot].node;
+}
+
+// note: only for GAP_IX_ADDR_TREE, the lowest-address sufficient gap at or
+// after from; subtrees entirely below from or without a large enough gap
+// are skipped, so this stays O(log n)
+static unsigned _mem_find_next_in_gap_ix(pool_mgr_pt pool_mgr,
+                                         unsigned root,
+                                         size_t size,
+                                         size_t from) {
+    gap_pt gap_ix = pool_mgr->gap_ix;
+
+    while (root != MEM_GAP_NIL && gap_ix[root].max_size >= size) {
+        if (_mem_node(pool_mgr, gap_ix[root].node)->offset < from) {
+            root = gap_ix[root].right;
+            continue;
+        }
+        unsigned node = _mem_find_next_in_gap_ix(pool_mgr, gap_ix[root].left,
+                                                 size, from);
+        if (node != MEM_NODE_NIL) return node;
+        if (gap_ix[root].size >= size) return gap_ix[root].node;
+        root = gap_ix[root].right;
+    }
+
+    return MEM_NODE_NIL;
 }
 
+// note: only for GAP_IX_ADDR_TREE, skips every subtree whose largest gap is
+// too small, so it finds the lowest-address sufficient gap in O(log n)
+static unsigned _mem_find_first_in_gap_ix(pool_mgr_pt pool_mgr, size_t size) {
+    gap_pt gap_ix = pool_mgr->gap_ix;
+    unsigned slot = pool_mgr->gap_root;
+
+    if (slot == MEM_GAP_NIL || gap_ix[slot].max_size < size)
+        return MEM_NODE_NIL;
+
+    for (;;) {
+        unsigned left = gap_ix[slot].left;
+        if (left != MEM_GAP_NIL && gap_ix[left].max_size >= size)
+            slot = left;
+        else if (gap_ix[slot].size >= size)
+            return gap_ix[slot].node;
+        else
+            slot = gap_ix[slot].right;
+    }
+}
+
+static alloc_status _mem_invalidate_gap_ix(pool_mgr_pt pool_mgr) {
+    // all slots go on the free slot list
+    for (unsigned u = 0; u < pool_mgr->gap_ix_capacity; u ++) {
+        pool_mgr->gap_ix[u].size = 0;
+        pool_mgr->gap_ix[u].node = MEM_NODE_NIL;
+        pool_mgr->gap_ix[u].next =
+                (u + 1 < pool_mgr->gap_ix_capacity) ? u + 1 : MEM_GAP_NIL;
+        pool_mgr->gap_ix[u].prev = MEM_GAP_NIL;
+        pool_mgr->gap_ix[u].up = MEM_GAP_NIL;
+        pool_mgr->gap_ix[u].height = 0;
+    }
+    pool_mgr->gap_ix_free = 0;
+    pool_mgr->gap_root = MEM_GAP_NIL;
+
+    // all size classes are empty
+    for (unsigned c = 0; c < MEM_GAP_NUM_CLASSES; c ++)
+        pool_mgr->gap_class[c] = MEM_GAP_NIL;
+    pool_mgr->gap_group_map = 0;
+    memset(pool_mgr->gap_class_map, 0, sizeof(pool_mgr->gap_class_map));
+
+    pool_mgr->pool.num_gaps = 0;
+    pool_mgr->small_gap_size = 0;
+
+    return ALLOC_OK;
+}
+
+static unsigned _mem_gap_class(size_t size) {
+    if (size < MEM_GAP_CLASS_SUBS) return (unsigned) size;
+
+    unsigned group = _mem_msb(size);
+    unsigned sub = (unsigned) (size >> (group - MEM_GAP_CLASS_SUB_BITS))
+                   - MEM_GAP_CLASS_SUBS;
+
+    return (group - MEM_GAP_CLASS_SUB_BITS + 1) * MEM_GAP_CLASS_SUBS + sub;
+}
+
+// first non-empty class at or above the given one, MEM_GAP_NIL if none
+static unsigned _mem_next_gap_class(pool_mgr_pt pool_mgr, unsigned size_class) {
+    unsigned group = size_class >> MEM_GAP_CLASS_SUB_BITS;
+    unsigned sub = size_class & (MEM_GAP_CLASS_SUBS - 1);
+
+    unsigned subs = pool_mgr->gap_class_map[group] & (0xffu << sub);
+    if (subs)
+        return (group << MEM_GAP_CLASS_SUB_BITS) + _mem_ctz(subs);
+
+    if (group + 1 == MEM_GAP_CLASS_GROUPS) return MEM_GAP_NIL;
+    uint64_t groups = pool_mgr->gap_group_map & (~(uint64_t) 0 << (group + 1));
+    if (groups == 0) return MEM_GAP_NIL;
+
+    group = _mem_ctz(groups);
+    return (group << MEM_GAP_CLASS_SUB_BITS)
+           + _mem_ctz(pool_mgr->gap_class_map[group]);
+}
+
+// the class tries are binary tries over gap index slots, one per size class,
+// keyed by (size, mem): first the size bits below those its class fixes,
+// then the offset bits, most significant first; an entry sits anywhere on
+// the path of its key, so a walk is never longer than the key
+static void _mem_insert_class_trie(pool_mgr_pt pool_mgr, unsigned slot) {
+    gap_pt gap_ix = pool_mgr->gap_ix;
+    gap_pt gap = &gap_ix[slot];
+    size_t offset = _mem_node(pool_mgr, gap->node)->offset;
+    unsigned size_class = _mem_gap_class(gap->size);
+    unsigned parent = pool_mgr->gap_class[size_class];
+
+    gap->left = MEM_GAP_NIL;
+    gap->right = MEM_GAP_NIL;
+    gap->up = MEM_GAP_NIL;
+    if (parent == MEM_GAP_NIL) {
+        pool_mgr->gap_class[size_class] = slot;
+        _mem_mark_gap_class(pool_mgr, size_class, 1);
+        return;
+    }
+
+    // hang it at the first free place on the path of its key
+    for (unsigned depth = 0; ; depth ++) {
+        unsigned *child =
+                _mem_class_trie_bit(pool_mgr, gap->size, offset, depth)
+                ? &gap_ix[parent].right : &gap_ix[parent].left;
+        if (*child == MEM_GAP_NIL) {
+            *child = slot;
+            gap->up = parent;
+            return;
+        }
+        parent = *child;
+    }
+}
+
+// note: any leaf below the entry shares the path above it, so a leaf takes
+// its place and nothing has to be compared
+static void _mem_remove_class_trie(pool_mgr_pt pool_mgr, unsigned slot) {
+    gap_pt gap_ix = pool_mgr->gap_ix;
+    gap_pt gap = &gap_ix[slot];
+    unsigned size_class = _mem_gap_class(gap->size);
+    unsigned leaf = slot;
+
+    while (gap_ix[leaf].left != MEM_GAP_NIL
+           || gap_ix[leaf].right != MEM_GAP_NIL)
+        leaf = (gap_ix[leaf].right != MEM_GAP_NIL) ? gap_ix[leaf].right
+                                                   : gap_ix[leaf].left;
+
+    if (leaf == slot) {
+        leaf = MEM_GAP_NIL;
+    } else {
+        // unhang the leaf, then give it the place and children of the entry
+        gap_pt up = &gap_ix[gap_ix[leaf].up];
+        if (up->left == leaf) up->left = MEM_GAP_NIL;
+        else up->right = MEM_GAP_NIL;
+        gap_ix[leaf].left = gap->left;
+        gap_ix[leaf].right = gap->right;
+        gap_ix[leaf].up = gap->up;
+        if (gap->left != MEM_GAP_NIL) gap_ix[gap->left].up = leaf;
+        if (gap->right != MEM_GAP_NIL) gap_ix[gap->right].up = leaf;
+    }
+
+    if (gap->up == MEM_GAP_NIL)
+        pool_mgr->gap_class[size_class] = leaf;
+    else if (gap_ix[gap->up].left == slot)
+        gap_ix[gap->up].left = leaf;
+    else
+        gap_ix[gap->up].right = leaf;
+
+    if (pool_mgr->gap_class[size_class] == MEM_GAP_NIL)
+        _mem_mark_gap_class(pool_mgr, size_class, 0);
+}
+
+// least entry of the class trie that is at least (size, 0), MEM_GAP_NIL if
+// none: the least on the path of that key, or in the last subtree the path
+// passes on its right, whose keys are all larger but smaller than any other
+static unsigned _mem_bound_class_trie(pool_mgr_pt pool_mgr,
+                                      unsigned size_class,
+                                      size_t size) {
+    gap_pt gap_ix = pool_mgr->gap_ix;
+    unsigned best = MEM_GAP_NIL;
+    unsigned larger = MEM_GAP_NIL;
+    unsigned slot = pool_mgr->gap_class[size_class];
+
+    for (unsigned depth = 0; slot != MEM_GAP_NIL; depth ++) {
+        if (gap_ix[slot].size >= size
+            && (best == MEM_GAP_NIL || _mem_gap_before(pool_mgr, slot, best)))
+            best = slot;
+        if (_mem_class_trie_bit(pool_mgr, size, 0, depth)) {
+            slot = gap_ix[slot].right;
+        } else {
+            if (gap_ix[slot].right != MEM_GAP_NIL) larger = gap_ix[slot].right;
+            slot = gap_ix[slot].left;
+        }
+    }
+
+    if (larger != MEM_GAP_NIL) {
+        larger = _mem_class_trie_end(pool_mgr, larger, 0);
+        if (best == MEM_GAP_NIL || _mem_gap_before(pool_mgr, larger, best))
+            best = larger;
+    }
+
+    return best;
+}
+
+// least (or, if last, greatest) entry of the subtree: every key on the left
+// is below every key on the right, so one side is enough at each level
+static unsigned _mem_class_trie_end(pool_mgr_pt pool_mgr,
+                                    unsigned slot,
+                                    int last) {
+    gap_pt gap_ix = pool_mgr->gap_ix;
+    unsigned end = slot;
+
+    while (slot != MEM_GAP_NIL) {
+        if (last ? _mem_gap_before(pool_mgr, end, slot)
+                 : _mem_gap_before(pool_mgr, slot, end))
+            end = slot;
+        unsigned near = last ? gap_ix[slot].right : gap_ix[slot].left;
+        unsigned far = last ? gap_ix[slot].left : gap_ix[slot].right;
+        slot = (near != MEM_GAP_NIL) ? near : far;
+    }
+
+    return end;
+}
+
+// bit of the key (size, offset) at the given depth of its class trie, 0 past
+// the end of the key
+static unsigned _mem_class_trie_bit(pool_mgr_pt pool_mgr,
+                                    size_t size,
+                                    size_t offset,
+                                    unsigned depth) {
+    // the class fixes the sizes below MEM_GAP_CLASS_SUBS, and the top
+    // MEM_GAP_CLASS_SUB_BITS + 1 bits of any other
+    unsigned size_bits = (size < MEM_GAP_CLASS_SUBS)
+                         ? 0 : _mem_msb(size) - MEM_GAP_CLASS_SUB_BITS;
+
+    if (depth < size_bits)
+        return (unsigned) (size >> (size_bits - 1 - depth)) & 1;
+    depth -= size_bits;
+    if (depth >= pool_mgr->gap_offset_bits) return 0;
+
+    return (unsigned) (offset >> (pool_mgr->gap_offset_bits - 1 - depth)) & 1;
+}
+
+static void _mem_mark_gap_class(pool_mgr_pt pool_mgr,
+                                unsigned size_class,
+                                int nonempty) {
+    unsigned group = size_class >> MEM_GAP_CLASS_SUB_BITS;
+    uint8_t bit = (uint8_t) (1u << (size_class & (MEM_GAP_CLASS_SUBS - 1)));
+
+    if (nonempty) {
+        pool_mgr->gap_class_map[group] |= bit;
+        pool_mgr->gap_group_map |= (uint64_t) 1 << group;
+    } else {
+        pool_mgr->gap_class_map[group] &= (uint8_t) ~bit;
+        if (pool_mgr->gap_class_map[group] == 0)
+            pool_mgr->gap_group_map &= ~((uint64_t) 1 << group);
+    }
+}
+
+// the gap tree is an AVL tree over gap index slots, ordered by (size, mem)
+// or, for GAP_IX_ADDR_TREE, by mem alone
+static unsigned _mem_insert_gap_tree(pool_mgr_pt pool_mgr,
+                                     unsigned root,
+                                     unsigned slot) {
+    gap_pt gap_ix = pool_mgr->gap_ix;
+
+    if (root == MEM_GAP_NIL) {
+        gap_ix[slot].left = MEM_GAP_NIL;
+        gap_ix[slot].right = MEM_GAP_NIL;
+        gap_ix[slot].height = 1;
+        gap_ix[slot].max_size = gap_ix[slot].size;
+        gap_ix[slot].min_size = gap_ix[slot].size;
+        return slot;
+    }
+
+    if (_mem_gap_before(pool_mgr, slot, root))
+        gap_ix[root].left =
+                _mem_insert_gap_tree(pool_mgr, gap_ix[root].left, slot);
+    else
+        gap_ix[root].right =
+                _mem_insert_gap_tree(pool_mgr, gap_ix[root].right, slot);
+
+    return _mem_balance_gap_tree(pool_mgr, root);
+}
+
+static unsigned _mem_remove_gap_tree(pool_mgr_pt pool_mgr,
+                                     unsigned root,
+                                     unsigned slot) {
+    gap_pt gap_ix = pool_mgr->gap_ix;
+
+    if (root == MEM_GAP_NIL) return MEM_GAP_NIL; // not in the tree
+
+    if (root != slot) {
+        if (_mem_gap_before(pool_mgr, slot, root))
+            gap_ix[root].left =
+                    _mem_remove_gap_tree(pool_mgr, gap_ix[root].left, slot);
+        else
+            gap_ix[root].right =
+                    _mem_remove_gap_tree(pool_mgr, gap_ix[root].right, slot);
+        return _mem_balance_gap_tree(pool_mgr, root);
+    }
+
+    // found it, so replace it with the leftmost entry of its right subtree
+    unsigned left = gap_ix[slot].left;
+    unsigned right = gap_ix[slot].right;
+    if (right == MEM_GAP_NIL) return left;
+    if (left == MEM_GAP_NIL) return right;
+
+    unsigned successor = right;
+    while (gap_ix[successor].left != MEM_GAP_NIL)
+        successor = gap_ix[successor].left;
+
+    gap_ix[successor].right =
+            _mem_remove_gap_tree(pool_mgr, right, successor);
+    gap_ix[successor].left = left;
+
+    return _mem_balance_gap_tree(pool_mgr, successor);
+}
+
+static unsigned _mem_balance_gap_tree(pool_mgr_pt pool_mgr, unsigned root) {
+    gap_pt gap_ix = pool_mgr->gap_ix;
+    unsigned left = gap_ix[root].left;
+    unsigned right = gap_ix[root].right;
+    unsigned lh = (left == MEM_GAP_NIL) ? 0 : gap_ix[left].height;
+    unsigned rh = (right == MEM_GAP_NIL) ? 0 : gap_ix[right].height;
+
+    if (lh > rh + 1) {
+        unsigned ll = gap_ix[left].left, lr = gap_ix[left].right;
+        if ((lr == MEM_GAP_NIL ? 0 : gap_ix[lr].height)
+            > (ll == MEM_GAP_NIL ? 0 : gap_ix[ll].height))
+            gap_ix[root].left = _mem_rotate_gap_tree(pool_mgr, left, 1);
+        return _mem_rotate_gap_tree(pool_mgr, root, 0);
+    }
+
+    if (rh > lh + 1) {
+        unsigned rl = gap_ix[right].left, rr = gap_ix[right].right;
+        if ((rl == MEM_GAP_NIL ? 0 : gap_ix[rl].height)
+            > (rr == MEM_GAP_NIL ? 0 : gap_ix[rr].height))
+            gap_ix[root].right = _mem_rotate_gap_tree(pool_mgr, right, 0);
+        return _mem_rotate_gap_tree(pool_mgr, root, 1);
+    }
+
+    _mem_update_gap_tree(pool_mgr, root);
+    return root;
+}
+
+// rotate left (the right child comes up) or right (the left child comes up)
+static unsigned _mem_rotate_gap_tree(pool_mgr_pt pool_mgr,
+                                     unsigned root,
+                                     int left) {
+    gap_pt gap_ix = pool_mgr->gap_ix;
+    unsigned top;
+
+    if (left) {
+        top = gap_ix[root].right;
+        gap_ix[root].right = gap_ix[top].left;
+        gap_ix[top].left = root;
+    } else {
+        top = gap_ix[root].left;
+        gap_ix[root].left = gap_ix[top].right;
+        gap_ix[top].right = root;
+    }
+    _mem_update_gap_tree(pool_mgr, root);
+    _mem_update_gap_tree(pool_mgr, top);
+
+    return top;
+}
+
+static void _mem_update_gap_tree(pool_mgr_pt pool_mgr, unsigned slot) {
+    gap_pt gap_ix = pool_mgr->gap_ix;
+    unsigned left = gap_ix[slot].left;
+    unsigned right = gap_ix[slot].right;
+    unsigned lh = (left == MEM_GAP_NIL) ? 0 : gap_ix[left].height;
+    unsigned rh = (right == MEM_GAP_NIL) ? 0 : gap_ix[right].height;
+
+    gap_ix[slot].height = 1 + ((lh > rh) ? lh : rh);
+
+    mem_off_t max_size = gap_ix[slot].size;
+    if (left != MEM_GAP_NIL && gap_ix[left].max_size > max_size)
+        max_size = gap_ix[left].max_size;
+    if (right != MEM_GAP_NIL && gap_ix[right].max_size > max_size)
+        max_size = gap_ix[right].max_size;
+    gap_ix[slot].max_size = max_size;
+
+    mem_off_t min_size = gap_ix[slot].size;
+    if (left != MEM_GAP_NIL && gap_ix[left].min_size < min_size)
+        min_size = gap_ix[left].min_size;
+    if (right != MEM_GAP_NIL && gap_ix[right].min_size < min_size)
+        min_size = gap_ix[right].min_size;
+    gap_ix[slot].min_size = min_size;
+}
+
+static int _mem_gap_before(pool_mgr_pt pool_mgr, unsigned a, unsigned b) {
+    gap_pt gap_ix = pool_mgr->gap_ix;
+
+    if (pool_mgr->gap_ix_kind != GAP_IX_ADDR_TREE
+        && gap_ix[a].size != gap_ix[b].size)
+        return gap_ix[a].size < gap_ix[b].size;
+
+    return _mem_node(pool_mgr, gap_ix[a].node)->offset
+           < _mem_node(pool_mgr, gap_ix[b].node)->offset;
+}
+
+static void * _mem_pool_alloc(pool_mgr_pt pool_mgr, size_t size) {
+    if (pool_mgr->pool.policy == BUDDY) return _mem_buddy_alloc(pool_mgr, size);
+    if (pool_mgr->pool.policy == SLAB) return _mem_slab_alloc(pool_mgr, size);
+    return _mem_node_alloc(pool_mgr, size);
+}
+
+static alloc_status _mem_pool_free(pool_mgr_pt pool_mgr, void *alloc) {
+    if (pool_mgr->pool.policy == BUDDY) return _mem_buddy_free(pool_mgr, alloc);
+    if (pool_mgr->pool.policy == SLAB) return _mem_slab_free(pool_mgr, alloc);
+    return _mem_node_free(pool_mgr, alloc);
+}
+
+// note: 0 if alloc is not an allocation of the pool
+static size_t _mem_alloc_size(pool_mgr_pt pool_mgr, char *alloc) {
+    if (alloc < pool_mgr->pool.mem
+        || alloc >= pool_mgr->pool.mem + pool_mgr->pool.total_size)
+        return 0;
+    size_t offset = (size_t) (alloc - pool_mgr->pool.mem);
+
+    if (pool_mgr->pool.policy == BUDDY) {
+        if (offset >= pool_mgr->buddy_size
+            || offset & (((size_t) 1 << MEM_BUDDY_MIN_ORDER) - 1))
+            return 0;
+        uint8_t entry = pool_mgr->buddy_map[offset >> MEM_BUDDY_MIN_ORDER];
+        if (! (entry & MEM_BUDDY_ALLOCATED)) return 0;
+        return (size_t) 1 << (entry & ~MEM_BUDDY_ALLOCATED);
+    }
+    if (pool_mgr->pool.policy == SLAB) {
+        size_t ix = offset / pool_mgr->slab_block;
+        if (offset % pool_mgr->slab_block
+            || ! ((pool_mgr->slab_map[ix / 64] >> (ix % 64)) & 1))
+            return 0;
+        return pool_mgr->slab_block;
+    }
+
+    unsigned ix = _mem_find_in_alloc_ix(pool_mgr, offset);
+    if (ix == MEM_ALLOC_IX_NIL) return 0;
+    return _mem_node(pool_mgr, pool_mgr->alloc_ix[ix])->size;
+}
+
+// note: a cached request is rounded up to the size of its class, which is
+// a multiple of the grain, or a power of two in a buddy pool, so that any
+// block of the class fits it
+static unsigned _mem_cache_class(pool_mgr_pt pool_mgr,
+                                 size_t size,
+                                 size_t *rounded) {
+    if (size == 0 || size > MEM_CACHE_CLASSES * MEM_CACHE_GRAIN)
+        return MEM_CACHE_NONE;
+
+    if (pool_mgr->pool.policy == BUDDY) {
+        *rounded = (size_t) 1 << MEM_BUDDY_MIN_ORDER;
+        while (*rounded < size) *rounded <<= 1;
+    } else {
+        *rounded = (size + MEM_CACHE_GRAIN - 1) / MEM_CACHE_GRAIN
+                   * MEM_CACHE_GRAIN;
+    }
+
+    return (unsigned) (*rounded / MEM_CACHE_GRAIN) - 1;
+}
+
+static mem_cache_pt _mem_thread_cache(pool_mgr_pt pool_mgr) {
+    mem_cache_slot_pt slot =
+            &thread_caches[pool_mgr->serial % MEM_THREAD_CACHE_SLOTS];
+    if (slot->pool_mgr == pool_mgr && slot->serial == pool_mgr->serial)
+        return slot->cache;
+
+    // the thread may have had a cache before another pool took its slot
+    _mem_lock(&pool_mgr->cache_lock);
+    mem_cache_pt cache = pool_mgr->caches;
+    while (cache != NULL && cache->owner != &thread_token)
+        cache = cache->next;
+    if (cache == NULL) {
+        cache = (mem_cache_pt) calloc(1, sizeof(mem_cache_t));
+        if (cache == NULL) {
+            perror("_mem_thread_cache");
+        } else {
+            cache->owner = &thread_token;
+            cache->next = pool_mgr->caches;
+            pool_mgr->caches = cache;
+        }
+    }
+    _mem_unlock(&pool_mgr->cache_lock);
+
+    if (cache != NULL) {
+        slot->pool_mgr = pool_mgr;
+        slot->serial = pool_mgr->serial;
+        slot->cache = cache;
+    }
+
+    return cache;
+}
+
+// note: the locks are taken in the order cache list, cache, pool
+static void * _mem_cache_alloc(pool_mgr_pt pool_mgr, size_t size) {
+    size_t rounded = size;
+    unsigned c = _mem_cache_class(pool_mgr, size, &rounded);
+    mem_cache_pt cache = (c == MEM_CACHE_NONE)
+                         ? NULL : _mem_thread_cache(pool_mgr);
+    void *alloc = NULL;
+
+    if (cache != NULL) {
+        _mem_lock(&cache->lock);
+        if (cache->count[c] == 0) {
+            // one trip to the pool sorts the deallocations and refills
+            _mem_lock_pool(pool_mgr);
+            _mem_cache_sort_freed(pool_mgr, cache);
+            while (cache->count[c] < MEM_CACHE_REFILL) {
+                char *block = _mem_pool_alloc(pool_mgr, rounded);
+                if (block == NULL) break;
+                _mem_cache_keep(pool_mgr, cache, c, block);
+            }
+            _mem_unlock_pool(pool_mgr);
+        }
+        if (cache->count[c] > 0) {
+            // the user holds the block now, and may deallocate it again
+            unsigned u = -- cache->count[c];
+            alloc = cache->blocks[c][u];
+            atomic_store_explicit(cache->parked[c][u], 0,
+                                  memory_order_relaxed);
+        }
+        _mem_unlock(&cache->lock);
+        if (alloc != NULL) return alloc;
+    }
+
+    _mem_lock_pool(pool_mgr);
+    alloc = _mem_pool_alloc(pool_mgr, size);
+    _mem_unlock_pool(pool_mgr);
+
+    // the blocks in the thread caches may be all that is left
+    if (alloc == NULL && size > 0) {
+        _mem_flush_parked(pool_mgr);
+        _mem_lock_pool(pool_mgr);
+        alloc = _mem_pool_alloc(pool_mgr, size);
+        _mem_unlock_pool(pool_mgr);
+    }
+
+    return alloc;
+}
+
+// note: only a pointer outside the pool is reported, the rest of the checks
+// wait until the deallocation is sorted, see _mem_cache_sort_freed
+static alloc_status _mem_cache_free(pool_mgr_pt pool_mgr, void *alloc) {
+    if ((char *) alloc < pool_mgr->pool.mem
+        || (char *) alloc >= pool_mgr->pool.mem + pool_mgr->pool.total_size)
+        return ALLOC_FAIL;
+
+    mem_cache_pt cache = _mem_thread_cache(pool_mgr);
+    alloc_status status;
+
+    if (cache == NULL) {
+        _mem_lock_pool(pool_mgr);
+        status = _mem_is_parked(pool_mgr, alloc)
+                 ? ALLOC_FAIL : _mem_pool_free(pool_mgr, alloc);
+        _mem_unlock_pool(pool_mgr);
+        return status;
+    }
+
+    _mem_lock(&cache->lock);
+    if (cache->num_freed == MEM_CACHE_BATCH) {
+        _mem_lock_pool(pool_mgr);
+        _mem_cache_sort_freed(pool_mgr, cache);
+        _mem_unlock_pool(pool_mgr);
+    }
+    cache->freed[cache->num_freed ++] = alloc;
+    _mem_unlock(&cache->lock);
+
+    return ALLOC_OK;
+}
+
+// note: holds the cache and the pool lock; the block is flagged as parked,
+// so that a deallocation of it through any cache is found out
+static void _mem_cache_keep(pool_mgr_pt pool_mgr,
+                            mem_cache_pt cache,
+                            unsigned c,
+                            char *block) {
+    atomic_uchar *parked = _mem_parked_flag(pool_mgr, block);
+
+    atomic_store_explicit(parked, 1, memory_order_relaxed);
+    cache->blocks[c][cache->count[c]] = block;
+    cache->parked[c][cache->count[c] ++] = parked;
+}
+
+// note: holds the cache and the pool lock; a deallocation of a block that
+// is not allocated, or that a cache holds already, is dropped and counted,
+// so a double free through any two caches is found out here, once per
+// batch; a block is kept if it is exactly the size of its class and the
+// class has room, otherwise really freed
+static void _mem_cache_sort_freed(pool_mgr_pt pool_mgr, mem_cache_pt cache) {
+    for (unsigned u = 0; u < cache->num_freed; u ++) {
+        char *block = cache->freed[u];
+        size_t size = _mem_alloc_size(pool_mgr, block);
+        if (size == 0 || _mem_is_parked(pool_mgr, block)) {
+            pool_mgr->late_fails ++;
+            continue;
+        }
+        size_t rounded = 0;
+        unsigned c = _mem_cache_class(pool_mgr, size, &rounded);
+        if (c != MEM_CACHE_NONE && rounded == size
+            && cache->count[c] < MEM_CACHE_DEPTH)
+            _mem_cache_keep(pool_mgr, cache, c, block);
+        else
+            _mem_pool_free(pool_mgr, block);
+    }
+    cache->num_freed = 0;
+}
+
+// note: holds the cache and the pool lock
+static void _mem_cache_flush(pool_mgr_pt pool_mgr, mem_cache_pt cache) {
+    _mem_cache_sort_freed(pool_mgr, cache);
+    for (unsigned c = 0; c < MEM_CACHE_CLASSES; c ++) {
+        while (cache->count[c] > 0) {
+            unsigned u = -- cache->count[c];
+            atomic_store_explicit(cache->parked[c][u], 0,
+                                  memory_order_relaxed);
+            _mem_pool_free(pool_mgr, cache->blocks[c][u]);
+        }
+    }
+}
+
+// note: holds the pool lock; NULL if alloc is not an allocation of the
+// pool, or the pool keeps no flag for it (no thread caches)
+static atomic_uchar * _mem_parked_flag(pool_mgr_pt pool_mgr, char *alloc) {
+    if (pool_mgr->pool.policy == SLAB || _mem_alloc_size(pool_mgr, alloc) == 0)
+        return NULL;
+    size_t offset = (size_t) (alloc - pool_mgr->pool.mem);
+
+    if (pool_mgr->pool.policy == BUDDY)
+        return (pool_mgr->buddy_parked == NULL)
+               ? NULL : &pool_mgr->buddy_parked[offset >> MEM_BUDDY_MIN_ORDER];
+    unsigned ix = _mem_find_in_alloc_ix(pool_mgr, offset);
+    return &_mem_node(pool_mgr, pool_mgr->alloc_ix[ix])->parked;
+}
+
+// note: holds the pool lock; whether a thread cache holds the block
+static int _mem_is_parked(pool_mgr_pt pool_mgr, char *alloc) {
+    atomic_uchar *parked = _mem_parked_flag(pool_mgr, alloc);
+
+    return parked != NULL
+           && atomic_load_explicit(parked, memory_order_relaxed) != 0;
+}
+
+static void _mem_flush_caches(pool_mgr_pt pool_mgr) {
+    if (! (pool_mgr->flags & POOL_THREAD_CACHE)) return;
+
+    _mem_lock(&pool_mgr->cache_lock);
+    for (mem_cache_pt cache = pool_mgr->caches;
+         cache != NULL;
+         cache = cache->next) {
+        _mem_lock(&cache->lock);
+        _mem_lock_pool(pool_mgr);
+        _mem_cache_flush(pool_mgr, cache);
+        _mem_unlock_pool(pool_mgr);
+        _mem_unlock(&cache->lock);
+    }
+    _mem_unlock(&pool_mgr->cache_lock);
+}
+
+// note: all a pusher can check without the pool lock; the link is written
+// into the block, so the whole link has to lie inside the pool
+static int _mem_remote_fits(pool_mgr_pt pool_mgr, const char *alloc) {
+    const char *mem = pool_mgr->pool.mem;
+
+    return alloc >= mem
+           && alloc + MEM_REMOTE_MIN_SIZE <= mem + pool_mgr->pool.total_size;
+}
+
+static void _mem_push_remote_free(pool_mgr_pt pool_mgr, char *alloc) {
+    char *head = atomic_load_explicit(&pool_mgr->remote_frees.head,
+                                      memory_order_relaxed);
+
+    // the block may not be aligned for a pointer, so the link is copied
+    do {
+        memcpy(alloc, &head, sizeof(char *));
+    } while (! atomic_compare_exchange_weak_explicit(
+            &pool_mgr->remote_frees.head, &head, alloc,
+            memory_order_release, memory_order_relaxed));
+}
+
+// note: called by the owner, or by any thread of a POOL_THREAD_SAFE pool;
+// taking the whole queue at once leaves no ABA problem to the pushers, and
+// the blocks go straight back to the pool, past any thread cache; every
+// step frees a live block, so the walk is bounded, and a block pushed twice
+// links back to a block freed by then, which ends it like a bad pointer
+// would (the rest of the queue is lost, its links cannot be trusted)
+static void _mem_drain_remote_frees(pool_mgr_pt pool_mgr) {
+    if (atomic_load_explicit(&pool_mgr->remote_frees.head,
+                             memory_order_relaxed) == NULL)
+        return;
+
+    char *alloc = atomic_exchange_explicit(&pool_mgr->remote_frees.head,
+                                           NULL,
+                                           memory_order_acquire);
+    _mem_lock_pool(pool_mgr);
+    while (alloc != NULL) {
+        if (_mem_alloc_size(pool_mgr, alloc) == 0
+            || _mem_is_parked(pool_mgr, alloc)) {
+            pool_mgr->late_fails ++;
+            break;
+        }
+        char *next;
+        memcpy(&next, alloc, sizeof(char *));
+        _mem_pool_free(pool_mgr, alloc);
+        alloc = next;
+    }
+    _mem_unlock_pool(pool_mgr);
+}
+
+// note: the blocks in the thread caches and in the remote free queue are
+// allocated as far as the pool can tell, but nobody holds them
+static void _mem_flush_parked(pool_mgr_pt pool_mgr) {
+    if (pool_mgr->flags & POOL_REMOTE_FREE) _mem_drain_remote_frees(pool_mgr);
+    _mem_flush_caches(pool_mgr);
+}
+
+// note: before a reset, which frees the parked blocks with everything else
+static void _mem_drop_parked(pool_mgr_pt pool_mgr) {
+    if (pool_mgr->flags & POOL_REMOTE_FREE)
+        atomic_exchange_explicit(&pool_mgr->remote_frees.head, NULL,
+                                 memory_order_acquire);
+    if (! (pool_mgr->flags & POOL_THREAD_CACHE)) return;
+
+    _mem_lock(&pool_mgr->cache_lock);
+    for (mem_cache_pt cache = pool_mgr->caches;
+         cache != NULL;
+         cache = cache->next) {
+        _mem_lock(&cache->lock);
+        memset(cache->count, 0, sizeof(cache->count));
+        cache->num_freed = 0;
+        _mem_unlock(&cache->lock);
+    }
+    _mem_unlock(&pool_mgr->cache_lock);
+}
+
+// note: holds the pool lock; the node heap is not walked, but the allocation
+// index is swept and the gap index rebuilt, so the cost is O(capacity of
+// the indexes), not of the allocations (a slab pool sweeps its block map,
+// and so does a buddy pool)
+static alloc_status _mem_pool_reset(pool_mgr_pt pool_mgr) {
+    pool_pt pool = &pool_mgr->pool;
+
+    pool->num_allocs = 0;
+    pool->alloc_size = 0;
+
+    // the marks go with the allocations
+    pool_mgr->marked = 0;
+    pool_mgr->mark_log_size = 0;
+    pool_mgr->num_marks = 0;
+    pool_mgr->mark_epoch ++;
+
+    if (pool->policy == BUDDY) {
+        _mem_buddy_reset(pool_mgr);
+        return ALLOC_OK;
+    }
+    if (pool->policy == SLAB) {
+        memset(pool_mgr->slab_map, 0,
+               (pool_mgr->slab_count + 63) / 64 * sizeof(uint64_t));
+        pool_mgr->slab_next = 0;
+        pool_mgr->slab_free = NULL;
+        pool->num_gaps = (unsigned) pool_mgr->slab_count;
+        return ALLOC_OK;
+    }
+
+    // the top node is the one gap again, and all the others are fresh
+    node_pt top = _mem_node(pool_mgr, 0);
+    top->offset = 0;
+    top->size = pool->total_size;
+    top->used = 1;
+    top->allocated = 0;
+    top->next = MEM_NODE_NIL;
+    top->prev = MEM_NODE_NIL;
+    atomic_store_explicit(&top->parked, 0, memory_order_relaxed);
+    pool_mgr->unused_nodes = MEM_NODE_NIL;
+    pool_mgr->fresh_node = 1;
+    pool_mgr->used_nodes = 1;
+    pool_mgr->rover = 0;
+
+    // the allocation index is emptied in one sweep (MEM_NODE_NIL is all ones)
+    memset(pool_mgr->alloc_ix, 0xff,
+           pool_mgr->alloc_ix_capacity * sizeof(unsigned));
+
+    _mem_invalidate_gap_ix(pool_mgr);
+    return _mem_add_to_gap_ix(pool_mgr, pool->total_size, 0);
+}
+
+static pool_mgr_pt _mem_shard_of(pool_mgr_pt pool_mgr, char *alloc) {
+    if (alloc < pool_mgr->pool.mem
+        || alloc >= pool_mgr->pool.mem + pool_mgr->pool.total_size)
+        return NULL;
+
+    // the last shard takes what is left over, so it may be a bit larger
+    size_t ix = (size_t) (alloc - pool_mgr->pool.mem) / pool_mgr->shard_size;
+    if (ix >= pool_mgr->num_shards) ix = pool_mgr->num_shards - 1;
+
+    return pool_mgr->shards[ix];
+}
+
+// note: holds the lock of the shard, so that the sum never runs behind it
+static void _mem_shard_sum(pool_mgr_pt pool_mgr,
+                           pool_mgr_pt shard,
+                           const pool_t *before) {
+    _mem_lock(&pool_mgr->lock);
+    pool_mgr->pool.alloc_size += shard->pool.alloc_size - before->alloc_size;
+    pool_mgr->pool.num_allocs += shard->pool.num_allocs - before->num_allocs;
+    pool_mgr->pool.num_gaps += shard->pool.num_gaps - before->num_gaps;
+    _mem_unlock(&pool_mgr->lock);
+}
+
+static unsigned _mem_home_shard(pool_mgr_pt pool_mgr) {
+    if (thread_shard == 0)
+        thread_shard = atomic_fetch_add_explicit(&shard_ticket, 1,
+                                                 memory_order_relaxed) + 1;
+    return thread_shard % pool_mgr->num_shards;
+}
+
+static void * _mem_shard_alloc(pool_mgr_pt pool_mgr, size_t size) {
+    unsigned home = _mem_home_shard(pool_mgr);
+    void *alloc = NULL;
+
+    // the home shard first, then steal from the others, one at a time
+    for (unsigned u = 0; u < pool_mgr->num_shards && alloc == NULL; u ++) {
+        pool_mgr_pt shard =
+                pool_mgr->shards[(home + u) % pool_mgr->num_shards];
+        _mem_lock(&shard->lock);
+        pool_t before = shard->pool;
+        alloc = _mem_pool_alloc(shard, size);
+        if (alloc != NULL) _mem_shard_sum(pool_mgr, shard, &before);
+        _mem_unlock(&shard->lock);
+    }
+
+    return alloc;
+}
+
+static alloc_status _mem_shard_free(pool_mgr_pt pool_mgr, void *alloc) {
+    pool_mgr_pt shard = _mem_shard_of(pool_mgr, alloc);
+    alloc_status status;
+
+    if (shard == NULL) return ALLOC_FAIL;
+
+    _mem_lock(&shard->lock);
+    pool_t before = shard->pool;
+    status = _mem_pool_free(shard, alloc);
+    _mem_shard_sum(pool_mgr, shard, &before);
+    _mem_unlock(&shard->lock);
+
+    return status;
+}
+
+// note: holds the pool lock; on failure the pool is as it was
+static alloc_status _mem_batch_alloc(pool_mgr_pt pool_mgr,
+                                     const size_t *sizes,
+                                     size_t n,
+                                     void **out,
+                                     size_t min_size) {
+    pool_pt pool = &pool_mgr->pool;
+    size_t total = 0;
+
+    for (size_t i = 0; i < n; i ++) {
+        size_t size = (sizes[i] < min_size) ? min_size : sizes[i];
+        if (sizes[i] == 0 || size > SIZE_MAX - total) return ALLOC_FAIL;
+        total += size;
+    }
+    if (total > pool->total_size - pool->alloc_size) return ALLOC_FAIL;
+
+    // the whole batch out of one gap, if there is one large enough
+    if (pool->policy != BUDDY && pool->policy != SLAB
+        && _mem_carve_batch(pool_mgr, sizes, n, out, min_size, total)
+           == ALLOC_OK)
+        return ALLOC_OK;
+
+    // otherwise one at a time, each from its own gap, and undo on failure
+    // (freeing in reverse merges the gaps back as they were, but the nodes
+    // may have been recycled, so the rover is found again by its offset)
+    size_t rover_offset = 0;
+    int rover_allocated = 0;
+    if (pool->policy == NEXT_FIT) {
+        node_pt rover = _mem_node(pool_mgr, pool_mgr->rover);
+        rover_offset = rover->offset;
+        rover_allocated = rover->allocated;
+    }
+    for (size_t i = 0; i < n; i ++) {
+        size_t size = (sizes[i] < min_size) ? min_size : sizes[i];
+        out[i] = _mem_pool_alloc(pool_mgr, size);
+        if (out[i] == NULL) {
+            while (i > 0) _mem_pool_free(pool_mgr, out[-- i]);
+            if (pool->policy == NEXT_FIT)
+                _mem_restore_rover(pool_mgr, rover_offset, rover_allocated);
+            return ALLOC_FAIL;
+        }
+    }
+
+    return ALLOC_OK;
+}
+
+// note: only for NEXT_FIT; if no node starts at the offset any more, the
+// rover stays where the pool left it, which is a used node as well
+static void _mem_restore_rover(pool_mgr_pt pool_mgr,
+                               size_t offset,
+                               int allocated) {
+    unsigned ix = MEM_NODE_NIL;
+
+    if (allocated) {
+        unsigned slot = _mem_find_in_alloc_ix(pool_mgr, offset);
+        if (slot != MEM_ALLOC_IX_NIL) ix = pool_mgr->alloc_ix[slot];
+    } else {
+        ix = _mem_find_next_in_gap_ix(pool_mgr, pool_mgr->gap_root,
+                                      1, offset);
+        if (ix != MEM_NODE_NIL && _mem_node(pool_mgr, ix)->offset != offset)
+            ix = MEM_NODE_NIL;
+    }
+    if (ix != MEM_NODE_NIL) pool_mgr->rover = ix;
+}
+
+// note: the gap index loses one gap and gets back at most one, the node
+// heap and the allocation index grow once for the whole batch; every
+// check comes before the carving, which cannot fail once it starts
+static alloc_status _mem_carve_batch(pool_mgr_pt pool_mgr,
+                                     const size_t *sizes,
+                                     size_t n,
+                                     void **out,
+                                     size_t min_size,
+                                     size_t total) {
+    pool_pt pool = &pool_mgr->pool;
+
+    if (pool->num_gaps == 0 || n >= UINT_MAX / 2) return ALLOC_FAIL;
+
+    // make room first, so that nothing fails halfway through the carving
+    // (a node per allocation, but the first, and one for the rest of the gap,
+    // which takes the gap index slot of the gap it is cut from)
+    if (_mem_resize_node_heap(pool_mgr, (unsigned) n) != ALLOC_OK
+        || pool_mgr->used_nodes + n > pool_mgr->total_nodes
+        || _mem_resize_alloc_ix(pool_mgr, (unsigned) n) != ALLOC_OK
+        || _mem_resize_gap_ix(pool_mgr) != ALLOC_OK
+        || pool_mgr->gap_ix_free == MEM_GAP_NIL)
+        return ALLOC_FAIL;
+
+    unsigned gap_ix = _mem_find_gap(pool_mgr, total);
+    if (gap_ix == MEM_NODE_NIL) return ALLOC_FAIL;
+    node_pt last = _mem_node(pool_mgr, gap_ix);
+    if (_mem_remove_from_gap_ix(pool_mgr, last->size, gap_ix) != ALLOC_OK)
+        return ALLOC_FAIL;
+
+    size_t offset = last->offset;
+    size_t remaining = last->size - total;
+    unsigned next_ix = last->next;
+    unsigned last_ix = gap_ix;
+
+    // the gap node becomes the first allocation, the others get new nodes,
+    // linked in address order
+    for (size_t i = 0; i < n; i ++) {
+        size_t size = (sizes[i] < min_size) ? min_size : sizes[i];
+        unsigned ix = gap_ix;
+        node_pt node = last;
+        if (i > 0) {
+            ix = _mem_get_unused_node(pool_mgr);
+            node = _mem_node(pool_mgr, ix);
+            node->used = 1;
+            node->prev = last_ix;
+            last->next = ix;
+            pool_mgr->used_nodes ++;
+        }
+        node->offset = offset;
+        node->size = size;
+        node->allocated = 1;
+        _mem_add_to_alloc_ix(pool_mgr, ix);
+        out[i] = pool->mem + offset;
+        offset += size;
+        last_ix = ix;
+        last = node;
+    }
+    pool_mgr->rover = last_ix;
+
+    // update metadata (num_allocs, alloc_size)
+    pool->num_allocs += (unsigned) n;
+    pool->alloc_size += total;
+
+    // the rest of the gap, if any, right after the last allocation
+    unsigned rest_ix = MEM_NODE_NIL;
+    if (remaining > 0) {
+        rest_ix = _mem_get_unused_node(pool_mgr);
+        node_pt rest = _mem_node(pool_mgr, rest_ix);
+        rest->offset = offset;
+        rest->size = remaining;
+        rest->used = 1;
+        rest->allocated = 0;
+        rest->prev = last_ix;
+        last->next = rest_ix;
+        pool_mgr->used_nodes ++;
+        last_ix = rest_ix;
+        last = rest;
+    }
+    last->next = next_ix;
+    if (next_ix != MEM_NODE_NIL) _mem_node(pool_mgr, next_ix)->prev = last_ix;
+
+    // (the gap index has room, see above)
+    if (rest_ix != MEM_NODE_NIL)
+        _mem_add_to_gap_ix(pool_mgr, remaining, rest_ix);
+
+    return ALLOC_OK;
+}
+
+// note: holds the pool lock; allocs are sorted by address and every one of
+// them is an allocation of the pool
+static alloc_status _mem_batch_free(pool_mgr_pt pool_mgr,
+                                    char **allocs,
+                                    size_t n) {
+    pool_pt pool = &pool_mgr->pool;
+    size_t i = 0;
+
+    if (pool->policy == BUDDY || pool->policy == SLAB) {
+        for (; i < n; i ++)
+            if (_mem_pool_free(pool_mgr, allocs[i]) != ALLOC_OK)
+                return ALLOC_FAIL;
+        return ALLOC_OK;
+    }
+
+    while (i < n) {
+        unsigned first_ix = pool_mgr->alloc_ix[_mem_find_in_alloc_ix(
+                pool_mgr, (size_t) (allocs[i] - pool->mem))];
+        node_pt first = _mem_node(pool_mgr, first_ix);
+
+        // the run merges into the gap before it, if there is one
+        unsigned gap_ix = first_ix;
+        if (first->prev != MEM_NODE_NIL
+            && ! _mem_node(pool_mgr, first->prev)->allocated) {
+            gap_ix = first->prev;
+            if (_mem_remove_from_gap_ix(pool_mgr,
+                                        _mem_node(pool_mgr, gap_ix)->size,
+                                        gap_ix) != ALLOC_OK)
+                return ALLOC_FAIL;
+        }
+        node_pt gap = _mem_node(pool_mgr, gap_ix);
+
+        // walk the list while the nodes are gaps or the next allocations
+        // of the batch, folding each into the one gap
+        unsigned ix = first_ix;
+        while (ix != MEM_NODE_NIL) {
+            node_pt node = _mem_node(pool_mgr, ix);
+            if (node->allocated) {
+                if (i == n || allocs[i] != pool->mem + node->offset) break;
+                i ++;
+                _mem_remove_from_alloc_ix(pool_mgr, ix);
+                pool->num_allocs --;
+                pool->alloc_size -= node->size;
+            } else if (_mem_remove_from_gap_ix(pool_mgr,
+                                               node->size,
+                                               ix) != ALLOC_OK) {
+                return ALLOC_FAIL;
+            }
+
+            unsigned next_ix = node->next;
+            if (ix == gap_ix) {
+                node->allocated = 0;
+            } else {
+                gap->size += node->size;
+                gap->next = next_ix;
+                if (next_ix != MEM_NODE_NIL)
+                    _mem_node(pool_mgr, next_ix)->prev = gap_ix;
+
+                // (and keep the rover on a used node)
+                if (pool_mgr->rover == ix) pool_mgr->rover = gap_ix;
+                node->used = 0;
+                node->offset = 0;
+                node->size = 0;
+                node->next = MEM_NODE_NIL;
+                node->prev = MEM_NODE_NIL;
+                pool_mgr->used_nodes --;
+                _mem_put_unused_node(pool_mgr, ix);
+            }
+            ix = next_ix;
+        }
+
+        // the gap index sees the merged gap only once
+        if (_mem_add_to_gap_ix(pool_mgr, gap->size, gap_ix) != ALLOC_OK)
+            return ALLOC_FAIL;
+    }
+
+    return ALLOC_OK;
+}
+
+static int _mem_compare_allocs(const void *a, const void *b) {
+    uintptr_t x = (uintptr_t) *(char * const *) a;
+    uintptr_t y = (uintptr_t) *(char * const *) b;
+
+    return (x > y) - (x < y);
+}
+
+// note: makes room for extra more entries, so that logging never fails;
+// no mark points past the innermost one, so the log from there on drops
+// what was deallocated since before it grows, and it only grows if it is
+// still more than half full, which keeps logging amortized O(1)
+static alloc_status _mem_resize_mark_log(pool_mgr_pt pool_mgr, size_t extra) {
+    size_t size = pool_mgr->mark_log_size;
+    size_t capacity = pool_mgr->mark_log_capacity;
+
+    if (extra > SIZE_MAX / sizeof(char *) / MEM_MARK_LOG_EXPAND_FACTOR - size)
+        return ALLOC_FAIL;
+    if (size + extra <= capacity) return ALLOC_OK;
+
+    if (pool_mgr->num_marks > 0) {
+        size_t depth = pool_mgr->mark_stack[pool_mgr->num_marks - 1];
+        size = depth + _mem_compact_mark_log(pool_mgr, depth);
+        if ((size + extra) * MEM_MARK_LOG_EXPAND_FACTOR <= capacity)
+            return ALLOC_OK;
+    }
+
+    capacity = (capacity == 0) ? MEM_MARK_LOG_INIT_CAPACITY
+                               : capacity * MEM_MARK_LOG_EXPAND_FACTOR;
+    while (capacity < size + extra) capacity *= MEM_MARK_LOG_EXPAND_FACTOR;
+    char **mark_log = (char **) realloc(pool_mgr->mark_log,
+                                        capacity * sizeof(char *));
+    if (mark_log == NULL) {
+        perror("_mem_resize_mark_log");
+        return ALLOC_FAIL;
+    }
+
+    pool_mgr->mark_log = mark_log;
+    pool_mgr->mark_log_capacity = capacity;
+
+    return ALLOC_OK;
+}
+
+// note: makes room for one more mark
+static alloc_status _mem_resize_mark_stack(pool_mgr_pt pool_mgr) {
+    unsigned capacity = pool_mgr->mark_stack_capacity;
+
+    if (pool_mgr->num_marks < capacity) return ALLOC_OK;
+    if (capacity > UINT_MAX / MEM_MARK_LOG_EXPAND_FACTOR) return ALLOC_FAIL;
+
+    capacity = (capacity == 0) ? MEM_MARK_STACK_INIT_CAPACITY
+                               : capacity * MEM_MARK_LOG_EXPAND_FACTOR;
+    size_t *mark_stack = (size_t *) realloc(pool_mgr->mark_stack,
+                                            capacity * sizeof(size_t));
+    if (mark_stack == NULL) {
+        perror("_mem_resize_mark_stack");
+        return ALLOC_FAIL;
+    }
+
+    pool_mgr->mark_stack = mark_stack;
+    pool_mgr->mark_stack_capacity = capacity;
+
+    return ALLOC_OK;
+}
+
+// note: a mark is outstanding until it is committed, or a mark before it is
+// released to or committed, or the pool is reset; a later mark of the same
+// level is told apart by its depth, and at the same depth it does the same
+static int _mem_mark_is_valid(pool_mgr_pt pool_mgr, pool_mark_t mark) {
+    return pool_mgr->marked
+           && mark.epoch == pool_mgr->mark_epoch
+           && mark.level < pool_mgr->num_marks
+           && pool_mgr->mark_stack[mark.level] == mark.depth;
+}
+
+// note: holds the pool lock; drops the allocations logged from depth on
+// that were deallocated since, and leaves the others sorted by address,
+// each once, returning how many there are
+static size_t _mem_compact_mark_log(pool_mgr_pt pool_mgr, size_t depth) {
+    char **allocs = pool_mgr->mark_log + depth;
+    size_t logged = pool_mgr->mark_log_size - depth;
+    size_t n = 0;
+    int sorted = 1;
+
+    // drop the ones deallocated since, keeping the order
+    for (size_t i = 0; i < logged; i ++) {
+        if (_mem_alloc_size(pool_mgr, allocs[i]) == 0) continue;
+        if (n > 0 && (uintptr_t) allocs[i] <= (uintptr_t) allocs[n - 1])
+            sorted = 0;
+        allocs[n ++] = allocs[i];
+    }
+
+    // allocations carved one after the other from the top are sorted
+    // already, which is the common case, and need no sorting
+    if (! sorted) {
+        qsort(allocs, n, sizeof(char *), _mem_compare_allocs);
+
+        // a block deallocated and allocated again is logged twice
+        size_t m = 0;
+        for (size_t i = 0; i < n; i ++)
+            if (m == 0 || allocs[i] != allocs[m - 1]) allocs[m ++] = allocs[i];
+        n = m;
+    }
+
+    pool_mgr->mark_log_size = depth + n;
+
+    return n;
+}
+
+// note: holds the pool lock; frees what is left of the allocations logged
+// from depth on, and cuts the log back to depth
+static alloc_status _mem_release_mark_log(pool_mgr_pt pool_mgr, size_t depth) {
+    size_t n = _mem_compact_mark_log(pool_mgr, depth);
+
+    pool_mgr->mark_log_size = depth;
+
+    return _mem_batch_free(pool_mgr, pool_mgr->mark_log + depth, n);
+}
+
+// note: holds the pool lock, alloc is an allocation of the pool; ALLOC_FAIL
+// if the block cannot take the new size where it is
+static alloc_status _mem_realloc_in_place(pool_mgr_pt pool_mgr,
+                                          char *alloc,
+                                          size_t size) {
+    if (pool_mgr->pool.policy == BUDDY)
+        return _mem_buddy_realloc(pool_mgr, alloc, size);
+    if (pool_mgr->pool.policy == SLAB)
+        return (size <= pool_mgr->slab_block) ? ALLOC_OK : ALLOC_FAIL;
+    return _mem_node_realloc(pool_mgr, alloc, size);
+}
+
+static void * _mem_node_alloc(pool_mgr_pt pool_mgr, size_t size) {
+    pool_pt pool = &pool_mgr->pool;
+
+    // check if any gaps, return null if none
+    if (size == 0 || pool->num_gaps == 0) return NULL;
+
+    // expand heap node, if necessary, quit on error
+    if (_mem_resize_node_heap(pool_mgr, 0) != ALLOC_OK) return NULL;
+    // check used nodes fewer than total nodes, quit on error
+    if (pool_mgr->used_nodes >= pool_mgr->total_nodes) return NULL;
+    // expand the allocation index, if necessary, quit on error
+    if (_mem_resize_alloc_ix(pool_mgr, 0) != ALLOC_OK) return NULL;
+
+    // get a node for allocation
+    unsigned alloc_node_ix = _mem_find_gap(pool_mgr, size);
+
+    // check if node found
+    if (alloc_node_ix == MEM_NODE_NIL) return NULL;
+    node_pt alloc_node = _mem_node(pool_mgr, alloc_node_ix);
+
+    // update metadata (num_allocs, alloc_size)
+    pool->num_allocs ++;
+    pool->alloc_size += size;
+
+    // calculate the size of the remaining gap, if any
+    size_t remaining = alloc_node->size - size;
+
+    // remove node from gap index
+    if (_mem_remove_from_gap_ix(pool_mgr,
+                                alloc_node->size,
+                                alloc_node_ix) != ALLOC_OK)
+        return NULL;
+
+    // convert gap_node to an allocation node of given size
+    alloc_node->allocated = 1;
+    alloc_node->size = size;
+    pool_mgr->rover = alloc_node_ix;
+    _mem_add_to_alloc_ix(pool_mgr, alloc_node_ix);
+
+    // adjust node heap:
+    //   if remaining gap, need a new node
+    if (remaining > 0) {
+        //   get an unused one from the node heap
+        unsigned gap_node_ix = _mem_get_unused_node(pool_mgr);
+        //   make sure one was found
+        if (gap_node_ix == MEM_NODE_NIL) return NULL;
+        node_pt gap_node = _mem_node(pool_mgr, gap_node_ix);
+
+        //   initialize it to a gap node
+        gap_node->offset = alloc_node->offset + size;
+        gap_node->size = remaining;
+        gap_node->used = 1;
+        gap_node->allocated = 0;
+
+        //   update metadata (used_nodes)
+        pool_mgr->used_nodes ++;
+
+        //   update linked list (new node right after the node for allocation)
+        gap_node->next = alloc_node->next;
+        if (alloc_node->next != MEM_NODE_NIL)
+            _mem_node(pool_mgr, alloc_node->next)->prev = gap_node_ix;
+        gap_node->prev = alloc_node_ix;
+        alloc_node->next = gap_node_ix;
+
+        //   add to gap index
+        //   check if successful
+        if (_mem_add_to_gap_ix(pool_mgr, remaining, gap_node_ix) != ALLOC_OK)
+            return NULL;
+    }
+
+    // return the allocated memory (see the README for the alloc record)
+    return pool->mem + alloc_node->offset;
+}
+
+static alloc_status _mem_node_free(pool_mgr_pt pool_mgr, void *alloc) {
+    pool_pt pool = &pool_mgr->pool;
+
+    // find the node in the allocation index
+    // this is node-to-delete
+    if ((char *) alloc < pool->mem
+        || (char *) alloc >= pool->mem + pool->total_size)
+        return ALLOC_FAIL;
+    unsigned ix = _mem_find_in_alloc_ix(pool_mgr,
+                                        (size_t) ((char *) alloc - pool->mem));
+    // make sure it's found
+    if (ix == MEM_ALLOC_IX_NIL) return ALLOC_FAIL;
+    unsigned del_ix = pool_mgr->alloc_ix[ix];
+    node_pt node_to_del = _mem_node(pool_mgr, del_ix);
+
+    // convert to gap node
+    _mem_remove_from_alloc_ix(pool_mgr, del_ix);
+    node_to_del->allocated = 0;
+
+    // update metadata (num_allocs, alloc_size)
+    pool->num_allocs --;
+    pool->alloc_size -= node_to_del->size;
+
+    // if the next node in the list is also a gap, merge into node-to-delete
+    unsigned next_ix = node_to_del->next;
+    node_pt next = (next_ix == MEM_NODE_NIL) ? NULL
+                                             : _mem_node(pool_mgr, next_ix);
+    if (next && ! next->allocated) {
+        //   remove the next node from gap index
+        //   check success
+        if (_mem_remove_from_gap_ix(pool_mgr,
+                                    next->size,
+                                    next_ix) != ALLOC_OK)
+            return ALLOC_FAIL;
+
+        //   add the size to the node-to-delete
+        node_to_del->size += next->size;
+
+        //   update node as unused (and keep the rover on a used node)
+        if (pool_mgr->rover == next_ix) pool_mgr->rover = del_ix;
+        next->used = 0;
+        next->offset = 0;
+        next->size = 0;
+
+        //   update metadata (used nodes)
+        pool_mgr->used_nodes --;
+
+        //   update linked list:
+        if (next->next != MEM_NODE_NIL) {
+            _mem_node(pool_mgr, next->next)->prev = del_ix;
+            node_to_del->next = next->next;
+        } else {
+            node_to_del->next = MEM_NODE_NIL;
+        }
+        next->next = MEM_NODE_NIL;
+        next->prev = MEM_NODE_NIL;
+        _mem_put_unused_node(pool_mgr, next_ix);
+    }
+
+    // this merged node-to-delete might need to be added to the gap index
+    // but one more thing to check...
+    // if the previous node in the list is also a gap, merge into previous!
+    unsigned prev_ix = node_to_del->prev;
+    node_pt prev = (prev_ix == MEM_NODE_NIL) ? NULL
+                                             : _mem_node(pool_mgr, prev_ix);
+    if (prev && ! prev->allocated) {
+        //   remove the previous node from gap index
+        //   check success
+        if (_mem_remove_from_gap_ix(pool_mgr,
+                                    prev->size,
+                                    prev_ix) != ALLOC_OK)
+            return ALLOC_FAIL;
+
+        //   add the size of node-to-delete to the previous
+        prev->size += node_to_del->size;
+
+        //   update node-to-delete as unused (and keep the rover on a used node)
+        if (pool_mgr->rover == del_ix) pool_mgr->rover = prev_ix;
+        node_to_del->used = 0;
+        node_to_del->offset = 0;
+        node_to_del->size = 0;
+
+        //   update metadata (used_nodes)
+        pool_mgr->used_nodes --;
+
+        //   update linked list
+        if (node_to_del->next != MEM_NODE_NIL) {
+            prev->next = node_to_del->next;
+            _mem_node(pool_mgr, node_to_del->next)->prev = prev_ix;
+        } else {
+            prev->next = MEM_NODE_NIL;
+        }
+        node_to_del->next = MEM_NODE_NIL;
+        node_to_del->prev = MEM_NODE_NIL;
+        _mem_put_unused_node(pool_mgr, del_ix);
+
+        //   change the node to add to the previous node!
+        node_to_del = prev;
+        del_ix = prev_ix;
+    }
+
+    // add the resulting node to the gap index
+    // check success
+    return _mem_add_to_gap_ix(pool_mgr,
+                              node_to_del->size,
+                              del_ix);
+}
+
+// note: the block keeps its offset, only the gap after it moves: a larger
+// block takes from that gap, a smaller one gives its tail to it, or to a
+// new gap if the next node is an allocation
+static alloc_status _mem_node_realloc(pool_mgr_pt pool_mgr,
+                                      char *alloc,
+                                      size_t size) {
+    pool_pt pool = &pool_mgr->pool;
+    unsigned ix = pool_mgr->alloc_ix[_mem_find_in_alloc_ix(
+            pool_mgr, (size_t) (alloc - pool->mem))];
+    node_pt node = _mem_node(pool_mgr, ix);
+    unsigned next_ix = node->next;
+    node_pt next = (next_ix == MEM_NODE_NIL) ? NULL
+                                             : _mem_node(pool_mgr, next_ix);
+
+    if (size == node->size) return ALLOC_OK;
+
+    if (size > node->size) {
+        size_t extra = size - node->size;
+
+        // the gap after the block has to hold all of the growth
+        if (next == NULL || next->allocated || next->size < extra)
+            return ALLOC_FAIL;
+        if (_mem_remove_from_gap_ix(pool_mgr,
+                                    next->size,
+                                    next_ix) != ALLOC_OK)
+            return ALLOC_FAIL;
+        node->size = size;
+        pool->alloc_size += extra;
+
+        // what is left of the gap starts further up
+        if (next->size > extra) {
+            next->offset += extra;
+            next->size -= extra;
+            return _mem_add_to_gap_ix(pool_mgr, next->size, next_ix);
+        }
+
+        // the gap is used up, its node goes (and keep the rover on a used
+        // node)
+        if (pool_mgr->rover == next_ix) pool_mgr->rover = ix;
+        node->next = next->next;
+        if (next->next != MEM_NODE_NIL)
+            _mem_node(pool_mgr, next->next)->prev = ix;
+        next->used = 0;
+        next->offset = 0;
+        next->size = 0;
+        next->next = MEM_NODE_NIL;
+        next->prev = MEM_NODE_NIL;
+        pool_mgr->used_nodes --;
+        _mem_put_unused_node(pool_mgr, next_ix);
+
+        return ALLOC_OK;
+    }
+
+    size_t tail = node->size - size;
+
+    // the tail joins the gap after the block
+    if (next != NULL && ! next->allocated) {
+        if (_mem_remove_from_gap_ix(pool_mgr,
+                                    next->size,
+                                    next_ix) != ALLOC_OK)
+            return ALLOC_FAIL;
+        node->size = size;
+        pool->alloc_size -= tail;
+        next->offset -= tail;
+        next->size += tail;
+        return _mem_add_to_gap_ix(pool_mgr, next->size, next_ix);
+    }
+
+    // or becomes a gap of its own, in a new node right after the block
+    if (_mem_resize_node_heap(pool_mgr, 0) != ALLOC_OK
+        || pool_mgr->used_nodes >= pool_mgr->total_nodes)
+        return ALLOC_FAIL;
+    unsigned gap_ix = _mem_get_unused_node(pool_mgr);
+    if (gap_ix == MEM_NODE_NIL) return ALLOC_FAIL;
+    node_pt gap = _mem_node(pool_mgr, gap_ix);
+    node->size = size;
+    pool->alloc_size -= tail;
+    gap->offset = node->offset + size;
+    gap->size = tail;
+    gap->used = 1;
+    gap->allocated = 0;
+    pool_mgr->used_nodes ++;
+    gap->next = next_ix;
+    if (next_ix != MEM_NODE_NIL) next->prev = gap_ix;
+    gap->prev = ix;
+    node->next = gap_ix;
+
+    return _mem_add_to_gap_ix(pool_mgr, tail, gap_ix);
+}
+
+static unsigned _mem_find_gap(pool_mgr_pt pool_mgr, size_t size) {
+    unsigned ix;
+
+    if (pool_mgr->pool.policy == FIRST_FIT) {
+        // if FIRST_FIT, then find the first sufficient node in the gap index
+        ix = _mem_find_first_in_gap_ix(pool_mgr, size);
+    } else if (pool_mgr->pool.policy == NEXT_FIT) {
+        // if NEXT_FIT, then resume from the last allocation and wrap around
+        size_t from = _mem_node(pool_mgr, pool_mgr->rover)->offset;
+        ix = _mem_find_next_in_gap_ix(pool_mgr, pool_mgr->gap_root,
+                                      size, from);
+        if (ix == MEM_NODE_NIL)
+            ix = _mem_find_first_in_gap_ix(pool_mgr, size);
+    } else if (pool_mgr->pool.policy == TLSF) {
+        // if TLSF, then take any node of the first class that surely fits
+        ix = _mem_find_good_in_gap_ix(pool_mgr, size);
+    } else {
+        // if BEST_FIT, then find the first sufficient node in the gap index
+        ix = _mem_find_in_gap_ix(pool_mgr, size);
+    }
+
+    return ix;
+}
+
+// note: the pool is cut into the largest blocks its size allows, in
+// descending order, so every block is aligned to its own size and the
+// buddy of a block is always found at offset ^ size; whatever is left
+// below the smallest block size is an unusable gap at the end
+static alloc_status _mem_buddy_init(pool_mgr_pt pool_mgr) {
+    size_t min_block = (size_t) 1 << MEM_BUDDY_MIN_ORDER;
+    size_t size = pool_mgr->pool.total_size & ~(min_block - 1);
+
+    pool_mgr->buddy_map = (uint8_t *) calloc((size >> MEM_BUDDY_MIN_ORDER) + 1,
+                                             sizeof(uint8_t));
+    if (pool_mgr->buddy_map == NULL) {
+        perror("_mem_buddy_init");
+        return ALLOC_FAIL;
+    }
+    if (pool_mgr->flags & POOL_THREAD_CACHE) {
+        pool_mgr->buddy_parked =
+                (atomic_uchar *) calloc((size >> MEM_BUDDY_MIN_ORDER) + 1,
+                                        sizeof(atomic_uchar));
+        if (pool_mgr->buddy_parked == NULL) {
+            perror("_mem_buddy_init");
+            return ALLOC_FAIL;
+        }
+    }
+    pool_mgr->buddy_size = size;
+    _mem_buddy_reset(pool_mgr);
+
+    return ALLOC_OK;
+}
+
+// note: the pool is cut into the largest blocks its size allows again
+static void _mem_buddy_reset(pool_mgr_pt pool_mgr) {
+    size_t size = pool_mgr->buddy_size;
+
+    memset(pool_mgr->buddy_map, 0, (size >> MEM_BUDDY_MIN_ORDER) + 1);
+    if (pool_mgr->buddy_parked != NULL)
+        for (size_t u = 0; u <= (size >> MEM_BUDDY_MIN_ORDER); u ++)
+            atomic_store_explicit(&pool_mgr->buddy_parked[u], 0,
+                                  memory_order_relaxed);
+    memset(pool_mgr->buddy_free, 0, sizeof(pool_mgr->buddy_free));
+    pool_mgr->buddy_free_map = 0;
+    pool_mgr->small_gap_size = 0;
+    pool_mgr->pool.num_gaps = 0;
+
+    size_t offset = 0;
+    for (unsigned order = MEM_BUDDY_ORDERS - 1;
+         order >= MEM_BUDDY_MIN_ORDER; order --) {
+        if (size & ((size_t) 1 << order)) {
+            _mem_buddy_push(pool_mgr, offset, order);
+            offset += (size_t) 1 << order;
+            pool_mgr->pool.num_gaps ++;
+        }
+    }
+    // the unusable tail is a gap, too
+    size_t tail = pool_mgr->pool.total_size - size;
+    if (tail > 0) {
+        pool_mgr->pool.num_gaps ++;
+        if (tail < pool_mgr->small_gap_threshold)
+            pool_mgr->small_gap_size += tail;
+    }
+}
+
+static void * _mem_buddy_alloc(pool_mgr_pt pool_mgr, size_t size) {
+    if (size == 0 || size > pool_mgr->buddy_size) return NULL;
+
+    // round up to a power of two
+    unsigned order = MEM_BUDDY_MIN_ORDER;
+    while (((size_t) 1 << order) < size) order ++;
+
+    // take a block from the smallest order that has one
+    uint64_t orders = pool_mgr->buddy_free_map & (~(uint64_t) 0 << order);
+    if (orders == 0) return NULL;
+    unsigned from = _mem_ctz(orders);
+    size_t offset = (size_t) ((char *) pool_mgr->buddy_free[from]
+                              - pool_mgr->pool.mem);
+    _mem_buddy_remove(pool_mgr, offset, from);
+
+    // split it, putting the upper halves on the free lists
+    while (from > order) {
+        from --;
+        _mem_buddy_push(pool_mgr, offset + ((size_t) 1 << from), from);
+        pool_mgr->pool.num_gaps ++;
+    }
+
+    pool_mgr->buddy_map[offset >> MEM_BUDDY_MIN_ORDER] =
+            (uint8_t) (order | MEM_BUDDY_ALLOCATED);
+    pool_mgr->pool.num_gaps --;
+    pool_mgr->pool.num_allocs ++;
+    pool_mgr->pool.alloc_size += (size_t) 1 << order;
+
+    return pool_mgr->pool.mem + offset;
+}
+
+static alloc_status _mem_buddy_free(pool_mgr_pt pool_mgr, void *alloc) {
+    // must be the start of an allocated block
+    if ((char *) alloc < pool_mgr->pool.mem
+        || (char *) alloc >= pool_mgr->pool.mem + pool_mgr->buddy_size)
+        return ALLOC_FAIL;
+    size_t offset = (size_t) ((char *) alloc - pool_mgr->pool.mem);
+    if (offset & (((size_t) 1 << MEM_BUDDY_MIN_ORDER) - 1)) return ALLOC_FAIL;
+    uint8_t entry = pool_mgr->buddy_map[offset >> MEM_BUDDY_MIN_ORDER];
+    if (! (entry & MEM_BUDDY_ALLOCATED)) return ALLOC_FAIL;
+
+    unsigned order = entry & ~MEM_BUDDY_ALLOCATED;
+    pool_mgr->buddy_map[offset >> MEM_BUDDY_MIN_ORDER] = 0;
+    pool_mgr->pool.num_allocs --;
+    pool_mgr->pool.alloc_size -= (size_t) 1 << order;
+
+    // merge with the buddy for as long as it is a free block of same order
+    while (order + 1 < MEM_BUDDY_ORDERS) {
+        size_t buddy = offset ^ ((size_t) 1 << order);
+        if (buddy >= pool_mgr->buddy_size
+            || pool_mgr->buddy_map[buddy >> MEM_BUDDY_MIN_ORDER] != order)
+            break;
+        _mem_buddy_remove(pool_mgr, buddy, order);
+        pool_mgr->pool.num_gaps --;
+        if (buddy < offset) offset = buddy;
+        order ++;
+    }
+
+    _mem_buddy_push(pool_mgr, offset, order);
+    pool_mgr->pool.num_gaps ++;
+
+    return ALLOC_OK;
+}
+
+// note: a smaller block gives its upper halves to the free lists, a larger
+// one can only take its upper buddies, and only if each is free whole
+static alloc_status _mem_buddy_realloc(pool_mgr_pt pool_mgr,
+                                       char *alloc,
+                                       size_t size) {
+    if (size > pool_mgr->buddy_size) return ALLOC_FAIL;
+    size_t offset = (size_t) (alloc - pool_mgr->pool.mem);
+    unsigned order = pool_mgr->buddy_map[offset >> MEM_BUDDY_MIN_ORDER]
+                     & ~MEM_BUDDY_ALLOCATED;
+
+    // round up to a power of two
+    unsigned want = MEM_BUDDY_MIN_ORDER;
+    while (((size_t) 1 << want) < size) want ++;
+
+    // check the whole growth before taking any of it
+    for (unsigned k = order; k < want; k ++) {
+        size_t buddy = offset + ((size_t) 1 << k);
+        if (offset & ((size_t) 1 << k) || buddy >= pool_mgr->buddy_size
+            || pool_mgr->buddy_map[buddy >> MEM_BUDDY_MIN_ORDER] != k)
+            return ALLOC_FAIL;
+    }
+
+    while (order < want) {
+        _mem_buddy_remove(pool_mgr, offset + ((size_t) 1 << order), order);
+        pool_mgr->pool.num_gaps --;
+        pool_mgr->pool.alloc_size += (size_t) 1 << order;
+        order ++;
+    }
+    while (order > want) {
+        order --;
+        _mem_buddy_push(pool_mgr, offset + ((size_t) 1 << order), order);
+        pool_mgr->pool.num_gaps ++;
+        pool_mgr->pool.alloc_size -= (size_t) 1 << order;
+    }
+
+    pool_mgr->buddy_map[offset >> MEM_BUDDY_MIN_ORDER] =
+            (uint8_t) (order | MEM_BUDDY_ALLOCATED);
+
+    return ALLOC_OK;
+}
+
+static void _mem_buddy_push(pool_mgr_pt pool_mgr, size_t offset,
+                            unsigned order) {
+    buddy_pt block = (buddy_pt) (pool_mgr->pool.mem + offset);
+
+    block->prev = NULL;
+    block->next = pool_mgr->buddy_free[order];
+    if (block->next) block->next->prev = block;
+    pool_mgr->buddy_free[order] = block;
+    pool_mgr->buddy_free_map |= (uint64_t) 1 << order;
+    if (((size_t) 1 << order) < pool_mgr->small_gap_threshold)
+        pool_mgr->small_gap_size += (size_t) 1 << order;
+
+    pool_mgr->buddy_map[offset >> MEM_BUDDY_MIN_ORDER] = (uint8_t) order;
+}
+
+static void _mem_buddy_remove(pool_mgr_pt pool_mgr, size_t offset,
+                              unsigned order) {
+    buddy_pt block = (buddy_pt) (pool_mgr->pool.mem + offset);
+
+    if (block->next) block->next->prev = block->prev;
+    if (block->prev) block->prev->next = block->next;
+    else pool_mgr->buddy_free[order] = block->next;
+    if (pool_mgr->buddy_free[order] == NULL)
+        pool_mgr->buddy_free_map &= ~((uint64_t) 1 << order);
+    if (((size_t) 1 << order) < pool_mgr->small_gap_threshold)
+        pool_mgr->small_gap_size -= (size_t) 1 << order;
+
+    pool_mgr->buddy_map[offset >> MEM_BUDDY_MIN_ORDER] = 0;
+}
+
+static void * _mem_slab_alloc(pool_mgr_pt pool_mgr, size_t size) {
+    if (size == 0 || size > pool_mgr->slab_block) return NULL;
+
+    // reuse the block freed last, or hand out the next untouched one
+    char *block = pool_mgr->slab_free;
+    if (block != NULL) {
+        pool_mgr->slab_free = *(char **) block;
+    } else if (pool_mgr->slab_next < pool_mgr->slab_count) {
+        block = pool_mgr->pool.mem
+                + pool_mgr->slab_next ++ * pool_mgr->slab_block;
+    } else {
+        return NULL;
+    }
+
+    size_t ix = (size_t) (block - pool_mgr->pool.mem) / pool_mgr->slab_block;
+    pool_mgr->slab_map[ix / 64] |= (uint64_t) 1 << (ix % 64);
+
+    pool_mgr->pool.num_gaps --;
+    pool_mgr->pool.num_allocs ++;
+    pool_mgr->pool.alloc_size += pool_mgr->slab_block;
+
+    return block;
+}
+
+static alloc_status _mem_slab_free(pool_mgr_pt pool_mgr, void *alloc) {
+    // must be the start of an allocated block
+    char *block = (char *) alloc;
+    if (block < pool_mgr->pool.mem
+        || block >= pool_mgr->pool.mem + pool_mgr->pool.total_size)
+        return ALLOC_FAIL;
+    size_t offset = (size_t) (block - pool_mgr->pool.mem);
+    if (offset % pool_mgr->slab_block) return ALLOC_FAIL;
+    size_t ix = offset / pool_mgr->slab_block;
+    uint64_t bit = (uint64_t) 1 << (ix % 64);
+    if (! (pool_mgr->slab_map[ix / 64] & bit)) return ALLOC_FAIL;
+
+    pool_mgr->slab_map[ix / 64] &= ~bit;
+    *(char **) block = pool_mgr->slab_free;
+    pool_mgr->slab_free = block;
+
+    pool_mgr->pool.num_gaps ++;
+    pool_mgr->pool.num_allocs --;
+    pool_mgr->pool.alloc_size -= pool_mgr->slab_block;
+
+    return ALLOC_OK;
+}
+
+// note: a cursor is the offset of the next segment and, in a pool with a
+// node heap, its node; it is rejected if no segment starts there any more
+static alloc_status _mem_next_segment(pool_mgr_pt pool_mgr,
+                                      pool_cursor_pt cursor,
+                                      pool_segment_pt segment) {
+    size_t offset = cursor->offset;
+    size_t size;
+    unsigned allocated;
+
+    // a sharded pool is its shards, one after the other, and the cursor
+    // moves on to the head node of the next
+    if (pool_mgr->num_shards > 0) {
+        pool_mgr_pt shard = _mem_shard_of(pool_mgr,
+                                          pool_mgr->pool.mem + offset);
+        if (shard == NULL) return ALLOC_FAIL;
+        size_t base = (size_t) (shard->pool.mem - pool_mgr->pool.mem);
+        pool_cursor_t local = {offset - base, cursor->node};
+        if (_mem_next_segment(shard, &local, segment) != ALLOC_OK)
+            return ALLOC_FAIL;
+        cursor->offset = base + local.offset;
+        cursor->node = (local.offset == shard->pool.total_size)
+                       ? 0 : local.node;
+        return ALLOC_OK;
+    }
+
+    if (pool_mgr->pool.policy == BUDDY) {
+        if (offset < pool_mgr->buddy_size) {
+            if (offset & (((size_t) 1 << MEM_BUDDY_MIN_ORDER) - 1))
+                return ALLOC_FAIL;
+            uint8_t entry = pool_mgr->buddy_map[offset >> MEM_BUDDY_MIN_ORDER];
+            if (entry == 0) return ALLOC_FAIL;
+            size = (size_t) 1 << (entry & ~MEM_BUDDY_ALLOCATED);
+            allocated = (entry & MEM_BUDDY_ALLOCATED) ? 1 : 0;
+        } else {
+            // the unusable tail below the smallest block
+            if (offset != pool_mgr->buddy_size) return ALLOC_FAIL;
+            size = pool_mgr->pool.total_size - offset;
+            allocated = 0;
+        }
+    } else if (pool_mgr->pool.policy == SLAB) {
+        if (offset % pool_mgr->slab_block) return ALLOC_FAIL;
+        size_t ix = offset / pool_mgr->slab_block;
+        size = pool_mgr->slab_block;
+        allocated = (unsigned) (pool_mgr->slab_map[ix / 64] >> (ix % 64)) & 1;
+    } else {
+        // (a fresh node may still hold what it was before a reset)
+        if (cursor->node >= pool_mgr->fresh_node) return ALLOC_FAIL;
+        node_pt node = _mem_node(pool_mgr, cursor->node);
+        if (! node->used || node->offset != offset) return ALLOC_FAIL;
+        size = node->size;
+        allocated = node->allocated;
+        cursor->node = node->next;
+    }
+
+    segment->size = size;
+    segment->allocated = allocated;
+    cursor->offset = offset + size;
+
+    return ALLOC_OK;
+}
+
+static alloc_status _mem_foreach_segment(pool_mgr_pt pool_mgr,
+                                         pool_segment_visitor visitor,
+                                         void *ctx) {
+    pool_cursor_t cursor = {0, 0};
+    pool_segment_t segment;
+
+    while (cursor.offset < pool_mgr->pool.total_size) {
+        if (_mem_next_segment(pool_mgr, &cursor, &segment) != ALLOC_OK)
+            return ALLOC_FAIL;
+        if (visitor(&segment, ctx)) break;
+    }
+
+    return ALLOC_OK;
+}
+
+// note: constant time from the gap tree root or the buddy order map, or one
+// edge of the tries of the smallest and of the largest size class
+static void _mem_gap_extremes(pool_mgr_pt pool_mgr,
+                              size_t *smallest,
+                              size_t *largest) {
+    gap_pt gap_ix = pool_mgr->gap_ix;
+
+    *smallest = 0;
+    *largest = 0;
+    if (pool_mgr->pool.num_gaps == 0) return;
+
+    // the extremes of a sharded pool are those of its shards
+    for (unsigned u = 0; u < pool_mgr->num_shards; u ++) {
+        size_t small, large;
+        _mem_gap_extremes(pool_mgr->shards[u], &small, &large);
+        if (small > 0 && (*smallest == 0 || small < *smallest))
+            *smallest = small;
+        if (large > *largest) *largest = large;
+    }
+    if (pool_mgr->num_shards > 0) return;
+
+    if (pool_mgr->pool.policy == SLAB) {
+        *smallest = *largest = pool_mgr->slab_block;
+    } else if (pool_mgr->pool.policy == BUDDY) {
+        size_t tail = pool_mgr->pool.total_size - pool_mgr->buddy_size;
+        if (pool_mgr->buddy_free_map) {
+            *smallest = (size_t) 1 << _mem_ctz(pool_mgr->buddy_free_map);
+            *largest = (size_t) 1 << _mem_msb(pool_mgr->buddy_free_map);
+        }
+        // the unusable tail is a gap, too
+        if (tail > 0) {
+            if (*smallest == 0 || tail < *smallest) *smallest = tail;
+            if (tail > *largest) *largest = tail;
+        }
+    } else if (pool_mgr->gap_ix_kind == GAP_IX_SIZE_TREE
+               || pool_mgr->gap_ix_kind == GAP_IX_ADDR_TREE) {
+        *smallest = gap_ix[pool_mgr->gap_root].min_size;
+        *largest = gap_ix[pool_mgr->gap_root].max_size;
+    } else {
+        unsigned low = _mem_next_gap_class(pool_mgr, 0);
+        unsigned group = _mem_msb(pool_mgr->gap_group_map);
+        unsigned high = (group << MEM_GAP_CLASS_SUB_BITS)
+                        + _mem_msb(pool_mgr->gap_class_map[group]);
+
+        unsigned first =
+                _mem_class_trie_end(pool_mgr, pool_mgr->gap_class[low], 0);
+        unsigned last =
+                _mem_class_trie_end(pool_mgr, pool_mgr->gap_class[high], 1);
+
+        *smallest = gap_ix[first].size;
+        *largest = gap_ix[last].size;
+    }
+}
+
+static int _mem_count_small_gap(const pool_segment_t *segment, void *ctx) {
+    pool_mgr_pt pool_mgr = (pool_mgr_pt) ctx;
+
+    if (! segment->allocated && segment->size < pool_mgr->small_gap_threshold)
+        pool_mgr->small_gap_size += segment->size;
+
+    return 0;
+}
+
+static unsigned _mem_ctz(uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+    return (unsigned) __builtin_ctzll(bits);
+#else
+    unsigned n = 0;
+    while (! (bits & 1)) { bits >>= 1; n ++; }
+    return n;
+#endif
+}
+
+static unsigned _mem_msb(uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - (unsigned) __builtin_clzll(bits);
+#else
+    unsigned n = 0;
+    while (bits >>= 1) n ++;
+    return n;
+#endif
+}
@@ -7,7 +7,21 @@
 
 /* type declarations */
 
-typedef enum _alloc_policy { FIRST_FIT, BEST_FIT } alloc_policy;
+typedef enum _alloc_policy {
+    FIRST_FIT,
+    BEST_FIT,
+    TLSF,
+    BUDDY,
+    SLAB,
+    NEXT_FIT
+} alloc_policy;
+
+typedef enum _pool_flag {
+    POOL_GAP_TREE = 0x1, // BEST_FIT: balanced tree gap index, not size classes
+    POOL_THREAD_SAFE = 0x2, // calls on the pool may come from several threads
+    POOL_THREAD_CACHE = 0x4, // POOL_THREAD_SAFE, small blocks cached per thread
+    POOL_REMOTE_FREE = 0x8 // other threads than the opener queue deallocations
+} pool_flag;
 
 typedef struct _pool {
     char *mem;
@@ -23,6 +37,29 @@ typedef struct _pool_segment {
     unsigned long allocated; // 1-allocation, 0-gap (note: 8 bytes)
 } pool_segment_t, *pool_segment_pt;
 
+// return nonzero to stop the walk
+typedef int (*pool_segment_visitor)(const pool_segment_t *segment, void *ctx);
+
+typedef struct _pool_cursor {
+    size_t offset; // of the next segment, zero the cursor to start at the top
+    unsigned node; // library use
+} pool_cursor_t, *pool_cursor_pt;
+
+typedef struct _pool_mark {
+    size_t depth; // library use
+    unsigned long epoch; // library use
+    unsigned level; // library use
+} pool_mark_t, *pool_mark_pt;
+
+typedef struct _pool_stats {
+    size_t free_size; // total_size - alloc_size
+    size_t largest_gap;
+    size_t smallest_gap;
+    size_t small_gap_threshold; // see mem_pool_track_small_gaps()
+    size_t small_gap_size; // bytes in gaps below the threshold
+    double fragmentation; // 1 - largest_gap / free_size
+} pool_stats_t, *pool_stats_pt;
+
 typedef enum _alloc_status {
     ALLOC_OK,
     ALLOC_FAIL,
@@ -41,15 +78,73 @@ mem_free();
 pool_pt
 mem_pool_open(size_t size, alloc_policy policy);
 
+pool_pt
+mem_pool_open_ex(size_t size, alloc_policy policy, unsigned flags);
+
+pool_pt
+mem_pool_open_fixed(size_t block_size, size_t count);
+
+pool_pt
+mem_pool_open_sharded(size_t size, alloc_policy policy, unsigned shards);
+
 alloc_status
 mem_pool_close(pool_pt pool);
 
 void *
 mem_new_alloc(pool_pt pool, size_t size);
 
+// note: in a POOL_THREAD_CACHE pool, only a pointer outside the pool fails
+// right away; the rest is checked when the cache visits the pool, and a
+// bad deallocation is dropped there and reported by mem_pool_flush_caches;
+// in a POOL_REMOTE_FREE pool, a thread other than the owner only
+// gets a range check, and the queue link is written into the block before
+// anything else, so the pointer must be one the pool handed out; the block
+// is validated late, when the owner takes the queue back, and a pointer
+// freed twice ends the queue there, dropping the rest, which
+// mem_pool_flush_caches reports
 alloc_status
 mem_del_alloc(pool_pt pool, void *alloc);
 
+void *
+mem_realloc_alloc(pool_pt pool, void *alloc, size_t size);
+
+alloc_status
+mem_new_alloc_batch(pool_pt pool, const size_t *sizes, size_t n, void **out);
+
+alloc_status
+mem_del_alloc_batch(pool_pt pool, void **allocs, size_t n);
+
+alloc_status
+mem_pool_reset(pool_pt pool);
+
+pool_mark_t
+mem_pool_mark(pool_pt pool);
+
+alloc_status
+mem_pool_release_to_mark(pool_pt pool, pool_mark_t mark);
+
+alloc_status
+mem_pool_commit_mark(pool_pt pool, pool_mark_t mark);
+
 void
 mem_inspect_pool(pool_pt pool, pool_segment_pt *segments, unsigned *num_segments);
+
+alloc_status
+mem_pool_foreach_segment(pool_pt pool, pool_segment_visitor visitor, void *ctx);
+
+alloc_status
+mem_inspect_pool_slice(pool_pt pool,
+                       pool_cursor_pt cursor,
+                       pool_segment_pt segments,
+                       unsigned capacity,
+                       unsigned *num_segments);
+
+alloc_status
+mem_pool_stats(pool_pt pool, pool_stats_pt stats);
+
+alloc_status
+mem_pool_track_small_gaps(pool_pt pool, size_t threshold);
+
+alloc_status
+mem_pool_flush_caches(pool_pt pool);
 #endif //C_MEM_POOL_H
@@ -4,6 +4,8 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 
 #include <stdarg.h>
 #include <stddef.h>
@@ -25,6 +27,9 @@
 
 static const unsigned NUM_TEST_ITERATIONS = NUM_ITERATIONS;
 static const unsigned POOL_SIZE           = 1000000;
+static const unsigned BUDDY_POOL_SIZE     = 1 << 20;
+static const unsigned SLAB_POOL_BLOCK_SIZE = 48;
+static const unsigned SLAB_POOL_BLOCKS    = 4;
 
 
 /*****         helper routines         *****/
@@ -1529,6 +1534,83 @@ static void test_pool_scenario10(void **state) {
     check_pool(pool, exp0);
 }
 
+static void test_pool_scenario24(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 24:
+     *
+     * 1. Pool starts out as a single gap.
+     * 2. Allocate 2000 x 100.
+     * 3. Deallocate every odd one, then 1200 and 1700, which leaves 998
+     *    gaps, all of 100 but two of 300 and the one at the bottom.
+     * 4. Allocate 250. Takes the 300 gap at 1199, past 600 allocations.
+     * 5. Allocate 260. Takes the 300 gap at 1699.
+     * 6. Allocate 100. Takes the 100 gap at 1.
+     * 7. Allocate 400. Takes the gap at the bottom, from 1999 on.
+     * 8. Clean up.
+     */
+
+    pool_segment_t exp0[1] =
+            {
+                    {pool->total_size, 0},
+            };
+    check_pool(pool, exp0);
+
+
+    const unsigned NUM_ALLOCS = 2000;
+
+    void * *allocs = (void * *) calloc(NUM_ALLOCS, sizeof(void *));
+    assert_non_null(allocs);
+
+    for (int i=0; i<NUM_ALLOCS; ++i) {
+        allocs[i] = mem_new_alloc(pool, 100);
+        assert_non_null(allocs[i]);
+    }
+    for (int i=1; i<NUM_ALLOCS; i+=2) {
+        status = mem_del_alloc(pool, allocs[i]);
+        assert_int_equal(status, ALLOC_OK);
+    }
+    status = mem_del_alloc(pool, allocs[1200]);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, allocs[1700]);
+    assert_int_equal(status, ALLOC_OK);
+    assert_int_equal(pool->num_allocs, 998);
+    assert_int_equal(pool->num_gaps, 998);
+
+
+    void * alloc0 = mem_new_alloc(pool, 250);
+    assert_true(alloc0 == allocs[1199]);
+    void * alloc1 = mem_new_alloc(pool, 260);
+    assert_true(alloc1 == allocs[1699]);
+    void * alloc2 = mem_new_alloc(pool, 100);
+    assert_true(alloc2 == allocs[1]);
+    void * alloc3 = mem_new_alloc(pool, 400);
+    assert_true(alloc3 == allocs[1999]);
+    assert_int_equal(pool->num_allocs, 1002);
+    assert_int_equal(pool->num_gaps, 997);
+
+
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc1);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc2);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc3);
+    assert_int_equal(status, ALLOC_OK);
+    for (int i=0; i<NUM_ALLOCS; i+=2) {
+        if (i == 1200 || i == 1700) continue;
+        status = mem_del_alloc(pool, allocs[i]);
+        assert_int_equal(status, ALLOC_OK);
+    }
+
+    check_pool(pool, exp0);
+
+    free(allocs);
+}
+
 /*******************************************/
 /***        4. BEST_FIT SCENARIOS        ***/
 /*******************************************/
@@ -1565,6 +1647,24 @@ static int pool_bf_teardown(void **state) {
     return 0;
 }
 
+static int pool_bf_tree_setup(void **state) {
+    alloc_status status;
+    const alloc_policy POOL_POLICY = BEST_FIT;
+    pool_pt pool = NULL;
+
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Allocating pool of %lu bytes with policy %s and a gap tree\n",
+         (long) POOL_SIZE, (POOL_POLICY == FIRST_FIT) ? "FIRST_FIT" : "BEST_FIT");
+    pool = mem_pool_open_ex(POOL_SIZE, POOL_POLICY, POOL_GAP_TREE);
+    assert_non_null(pool);
+
+    *state = pool;
+
+    return 0;
+}
+
 static void dummy_test(void **state) {
     (void) state;
 }
@@ -2314,122 +2414,2196 @@ static void test_pool_scenario19(void **state) {
 }
 
 /*******************************************/
-/***        5. STRESS TESTING            ***/
+/***          5. TLSF SCENARIOS          ***/
 /*******************************************/
 
-void test_pool_stresstest0(void **state) {
-    (void) state; /* unused */
+static int pool_tlsf_setup(void **state) {
+    alloc_status status;
+    pool_pt pool = NULL;
 
-    const unsigned num_pools = 200;
-    const unsigned num_allocations = 1000;
-    const unsigned min_alloc_size = 10;
-    const unsigned pool_size =
-            (num_allocations / 2) *
-            (2 * min_alloc_size + (num_allocations - 1) * min_alloc_size);
-    assert_int_equal(pool_size, 5005000);
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Allocating pool of %lu bytes with policy TLSF\n", (long) POOL_SIZE);
+    pool = mem_pool_open(POOL_SIZE, TLSF);
+    assert_non_null(pool);
 
+    *state = pool;
 
-    pool_pt pools[num_pools];
-    void *allocations[num_pools][num_allocations];
+    return 0;
+}
+
+static int pool_tlsf_teardown(void **state) {
+    pool_pt pool = *state;
+    alloc_status status;
+
+    INFO("Closing pool\n");
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_free();
+    assert_int_equal(status, ALLOC_OK);
+
+    return 0;
+}
+
+static void test_pool_scenario20(void **state) {
+    pool_pt pool = *state;
 
     /*
-     * Testing dynamic reallocation of pool structures:
+     * Scenario 20:
      *
-     * 1. 200 pools of 5005000 each (many pools)
-     * 2. In each pool 1000 allocations of different sizes (many allocations)
-     * 3. In each pool 500 deallocations (many gaps)
+     * 1. Pool starts out as a single gap.
+     * 2. Allocate 10 x 100.
+     * 3. Deallocate (2, 1, 3), (6, 5), 8
+     * 4. Allocate 50. Takes the 100 gap, the first class that surely fits.
+     * 5. Allocate 150. Takes the 200 gap.
+     * 6. Allocate 40. Takes the 50 gap freed last.
+     * 7. Clean up.
      */
 
-    // initialize store
-    assert_int_equal(mem_init(), ALLOC_OK);
+    pool_segment_t exp0[1] =
+            {
+                    {pool->total_size, 0},
+            };
+    check_pool(pool, exp0);
 
-    // allocate pools
-    for (unsigned pix=0; pix < num_pools; ++pix) {
-        // open pool
-        pools[pix] =
-                mem_pool_open(pool_size, (pix % 2) ? FIRST_FIT : BEST_FIT);
-        assert_non_null(pools[pix]);
-        // allocate pool
-        unsigned allocated = 0;
-        for (unsigned aix=0; aix < num_allocations; ++aix) {
-            allocations[pix][aix] =
-                    mem_new_alloc(pools[pix], (aix + 1) * min_alloc_size);
-            allocated += (aix + 1) * min_alloc_size;
-            if (!allocations[pix][aix]) {
-                INFO("ASSERT WILL FAIL at pix = %u, aix = %u, allocated = %u\n", pix, aix, allocated);
-            }
-            assert_non_null(allocations[pix][aix]);
-        }
 
-        // delete every other allocation
-        for (unsigned aix=0; aix < num_allocations; ++aix) {
-            if (aix % 2) {
-                assert_int_equal(
-                        mem_del_alloc(pools[pix], allocations[pix][aix]),
-                        ALLOC_OK);
-                allocations[pix][aix] = NULL;
-            }
-        }
+    const unsigned NUM_ALLOCS = 10;
+
+    void * *allocs = (void * *) calloc(NUM_ALLOCS, sizeof(void *));
+    assert_non_null(allocs);
+
+    for (int i=0; i<NUM_ALLOCS; ++i) {
+        allocs[i] = mem_new_alloc(pool, 100);
+        assert_non_null(allocs[i]);
     }
+    assert_int_equal(mem_del_alloc(pool, allocs[2]), ALLOC_OK); allocs[2]=0;
+    assert_int_equal(mem_del_alloc(pool, allocs[1]), ALLOC_OK); allocs[1]=0;
+    assert_int_equal(mem_del_alloc(pool, allocs[3]), ALLOC_OK); allocs[3]=0;
+    assert_int_equal(mem_del_alloc(pool, allocs[6]), ALLOC_OK); allocs[6]=0;
+    assert_int_equal(mem_del_alloc(pool, allocs[5]), ALLOC_OK); allocs[5]=0;
+    assert_int_equal(mem_del_alloc(pool, allocs[8]), ALLOC_OK); allocs[8]=0;
 
-    // delete pools
-    for (unsigned pix=0; pix < num_pools; ++pix) {
-        // delete pool's allocations
-        for (unsigned aix=0; aix < num_allocations; ++aix) {
-            if (allocations[pix][aix]) {
-                // delete allocation
-                assert_int_equal(
-                        mem_del_alloc(pools[pix], allocations[pix][aix]),
-                        ALLOC_OK);
-            }
-        }
-        // close pool
-        assert_int_equal(mem_pool_close(pools[pix]), ALLOC_OK);
+
+    void * alloc0 = mem_new_alloc(pool, 50);
+    assert_non_null(alloc0);
+    pool_segment_t exp1[9] =
+            {
+                    {100, 1},
+                    {300, 0},
+                    {100, 1},
+                    {200, 0},
+                    {100, 1},
+                    {50, 1},
+                    {50, 0},
+                    {100, 1},
+                    {pool->total_size - 1000, 0},
+            };
+    check_pool(pool, exp1);
+
+
+    void * alloc1 = mem_new_alloc(pool, 150);
+    assert_non_null(alloc1);
+    void * alloc2 = mem_new_alloc(pool, 40);
+    assert_non_null(alloc2);
+    pool_segment_t exp2[11] =
+            {
+                    {100, 1},
+                    {300, 0},
+                    {100, 1},
+                    {150, 1},
+                    {40, 1},
+                    {10, 0},
+                    {100, 1},
+                    {50, 1},
+                    {50, 0},
+                    {100, 1},
+                    {pool->total_size - 1000, 0},
+            };
+    check_pool(pool, exp2);
+    assert_int_equal(pool->num_gaps, 4);
+
+
+    // clean up
+    for (int i=0; i<NUM_ALLOCS; ++i) {
+        if (allocs[i])
+            assert_int_equal(mem_del_alloc(pool, allocs[i]), ALLOC_OK);
     }
+    free(allocs);
+    assert_int_equal(mem_del_alloc(pool, alloc0), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc1), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc2), ALLOC_OK);
 
-    // free store
-    assert_int_equal(mem_free(), ALLOC_OK);
-}
 
+    check_pool(pool, exp0);
+}
 
 /*******************************************/
-/***         6. DRIVER ROUTINE           ***/
+/***         6. BUDDY SCENARIOS          ***/
 /*******************************************/
 
-int run_test_suite() {
-    const struct CMUnitTest tests[] = {
-            // General tests
-            cmocka_unit_test(test_pool_store_smoketest),
-            cmocka_unit_test(test_pool_smoketest),
+static int pool_buddy_setup(void **state) {
+    alloc_status status;
+    pool_pt pool = NULL;
 
-            cmocka_unit_test(test_pool_nonempty),
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
 
-            cmocka_unit_test_setup_teardown(test_pool_ff_metadata, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_bf_metadata, pool_bf_setup, pool_bf_teardown),
+    INFO("Allocating pool of %lu bytes with policy BUDDY\n", (long) BUDDY_POOL_SIZE);
+    pool = mem_pool_open(BUDDY_POOL_SIZE, BUDDY);
+    assert_non_null(pool);
 
-            // First-fit tests
-            cmocka_unit_test_setup_teardown(test_pool_scenario00, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario01, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario02, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario03, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario04, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario05, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario06, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario07, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario08, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario09, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario10, pool_ff_setup, pool_ff_teardown),
+    *state = pool;
 
-            // Best-fit tests
-            cmocka_unit_test_setup_teardown(test_pool_scenario11, pool_bf_setup, pool_bf_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario12, pool_bf_setup, pool_bf_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario13, pool_bf_setup, pool_bf_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario14, pool_bf_setup, pool_bf_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario15, pool_bf_setup, pool_bf_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario16, pool_bf_setup, pool_bf_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario17, pool_bf_setup, pool_bf_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario18, pool_bf_setup, pool_bf_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario19, pool_bf_setup, pool_bf_teardown),
+    return 0;
+}
+
+static int pool_buddy_teardown(void **state) {
+    pool_pt pool = *state;
+    alloc_status status;
+
+    INFO("Closing pool\n");
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_free();
+    assert_int_equal(status, ALLOC_OK);
+
+    return 0;
+}
+
+static void test_pool_scenario21(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 21:
+     *
+     * 1. Pool starts out as a single block of 2^20.
+     * 2. Allocate 100. Gets a 128 block, splitting off one buddy per order.
+     * 3. Allocate 64. Splits the 128 buddy.
+     * 4. Deallocate the 100. Its buddy is split, so no merge.
+     * 5. Deallocate the 64. Buddies merge back into a single block.
+     */
+
+    pool_segment_t exp0[1] =
+            {
+                    {pool->total_size, 0}
+            };
+    check_metadata(pool, BUDDY, BUDDY_POOL_SIZE, 0, 0, 1);
+    check_pool(pool, exp0);
+
+
+    void * alloc0 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc0);
+
+    pool_segment_t exp1[14] =
+            {
+                    {128, 1},
+                    {128, 0},
+                    {256, 0},
+                    {512, 0},
+                    {1024, 0},
+                    {2048, 0},
+                    {4096, 0},
+                    {8192, 0},
+                    {16384, 0},
+                    {32768, 0},
+                    {65536, 0},
+                    {131072, 0},
+                    {262144, 0},
+                    {524288, 0},
+            };
+    check_metadata(pool, BUDDY, BUDDY_POOL_SIZE, 128, 1, 13);
+    check_pool(pool, exp1);
+
+
+    void * alloc1 = mem_new_alloc(pool, 64);
+    assert_non_null(alloc1);
+    assert_true((char *) alloc1 == (char *) alloc0 + 128);
+
+    pool_segment_t exp2[15] =
+            {
+                    {128, 1},
+                    {64, 1},
+                    {64, 0},
+                    {256, 0},
+                    {512, 0},
+                    {1024, 0},
+                    {2048, 0},
+                    {4096, 0},
+                    {8192, 0},
+                    {16384, 0},
+                    {32768, 0},
+                    {65536, 0},
+                    {131072, 0},
+                    {262144, 0},
+                    {524288, 0},
+            };
+    check_metadata(pool, BUDDY, BUDDY_POOL_SIZE, 192, 2, 13);
+    check_pool(pool, exp2);
+
+
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_FAIL);
+
+    pool_segment_t exp3[15] =
+            {
+                    {128, 0},
+                    {64, 1},
+                    {64, 0},
+                    {256, 0},
+                    {512, 0},
+                    {1024, 0},
+                    {2048, 0},
+                    {4096, 0},
+                    {8192, 0},
+                    {16384, 0},
+                    {32768, 0},
+                    {65536, 0},
+                    {131072, 0},
+                    {262144, 0},
+                    {524288, 0},
+            };
+    check_metadata(pool, BUDDY, BUDDY_POOL_SIZE, 64, 1, 14);
+    check_pool(pool, exp3);
+
+
+    status = mem_del_alloc(pool, alloc1);
+    assert_int_equal(status, ALLOC_OK);
+
+    check_metadata(pool, BUDDY, BUDDY_POOL_SIZE, 0, 0, 1);
+    check_pool(pool, exp0);
+}
+
+/*******************************************/
+/***          7. SLAB SCENARIOS          ***/
+/*******************************************/
+
+static int pool_slab_setup(void **state) {
+    alloc_status status;
+    pool_pt pool = NULL;
+
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Allocating pool of %u blocks of %u bytes\n",
+         SLAB_POOL_BLOCKS, SLAB_POOL_BLOCK_SIZE);
+    pool = mem_pool_open_fixed(SLAB_POOL_BLOCK_SIZE, SLAB_POOL_BLOCKS);
+    assert_non_null(pool);
+
+    *state = pool;
+
+    return 0;
+}
+
+static int pool_slab_teardown(void **state) {
+    pool_pt pool = *state;
+    alloc_status status;
+
+    INFO("Closing pool\n");
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_free();
+    assert_int_equal(status, ALLOC_OK);
+
+    return 0;
+}
+
+static void test_pool_scenario22(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+    const unsigned BLOCK = SLAB_POOL_BLOCK_SIZE;
+
+    /*
+     * Scenario 22:
+     *
+     * 1. Pool starts out as 4 free blocks.
+     * 2. Allocate 3 blocks. They are handed out in order.
+     * 3. Deallocate the second one.
+     * 4. Allocate again. Gets the block freed last.
+     * 5. Allocate more than a block. Fails.
+     * 6. Clean up.
+     */
+
+    pool_segment_t exp0[4] =
+            {
+                    {BLOCK, 0},
+                    {BLOCK, 0},
+                    {BLOCK, 0},
+                    {BLOCK, 0},
+            };
+    check_metadata(pool, SLAB, 4 * BLOCK, 0, 0, 4);
+    check_pool(pool, exp0);
+
+
+    void * alloc0 = mem_new_alloc(pool, BLOCK);
+    void * alloc1 = mem_new_alloc(pool, 1);
+    void * alloc2 = mem_new_alloc(pool, BLOCK / 2);
+    assert_non_null(alloc0);
+    assert_true((char *) alloc1 == (char *) alloc0 + BLOCK);
+    assert_true((char *) alloc2 == (char *) alloc1 + BLOCK);
+
+    status = mem_del_alloc(pool, alloc1);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc1);
+    assert_int_equal(status, ALLOC_FAIL);
+    status = mem_del_alloc(pool, (char *) alloc2 + 1);
+    assert_int_equal(status, ALLOC_FAIL);
+
+    pool_segment_t exp1[4] =
+            {
+                    {BLOCK, 1},
+                    {BLOCK, 0},
+                    {BLOCK, 1},
+                    {BLOCK, 0},
+            };
+    check_metadata(pool, SLAB, 4 * BLOCK, 2 * BLOCK, 2, 2);
+    check_pool(pool, exp1);
+
+
+    void * alloc3 = mem_new_alloc(pool, BLOCK);
+    assert_true(alloc3 == alloc1);
+    assert_null(mem_new_alloc(pool, BLOCK + 1));
+    assert_int_equal(mem_pool_close(pool), ALLOC_NOT_FREED);
+
+
+    // clean up
+    assert_int_equal(mem_del_alloc(pool, alloc0), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc2), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc3), ALLOC_OK);
+
+    check_metadata(pool, SLAB, 4 * BLOCK, 0, 0, 4);
+    check_pool(pool, exp0);
+}
+
+/*******************************************/
+/***        8. NEXT_FIT SCENARIOS        ***/
+/*******************************************/
+
+static int pool_nf_setup(void **state) {
+    alloc_status status;
+    pool_pt pool = NULL;
+
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Allocating pool of %lu bytes with policy NEXT_FIT\n", (long) POOL_SIZE);
+    pool = mem_pool_open(POOL_SIZE, NEXT_FIT);
+    assert_non_null(pool);
+
+    *state = pool;
+
+    return 0;
+}
+
+static int pool_nf_teardown(void **state) {
+    pool_pt pool = *state;
+    alloc_status status;
+
+    INFO("Closing pool\n");
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_free();
+    assert_int_equal(status, ALLOC_OK);
+
+    return 0;
+}
+
+static void test_pool_scenario23(void **state) {
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 23:
+     *
+     * 1. Pool starts out as a single gap.
+     * 2. Allocate 100 and 100, deallocate the first 100.
+     * 3. Allocate 50. Goes after the last allocation, not in the top gap.
+     * 4. Allocate the rest of the pool.
+     * 5. Allocate 60. Wraps around to the top gap.
+     * 6. Deallocate the second 100, allocate 10. Goes right after the 60.
+     * 7. Deallocate the 10, then the 60, which absorbs the 10's node.
+     * 8. Allocate 5. Goes at the top, where the 60 was.
+     * 9. Clean up.
+     */
+
+    pool_segment_t exp0[1] =
+            {
+                    {pool->total_size, 0}
+            };
+    check_pool(pool, exp0);
+
+
+    void * alloc0 = mem_new_alloc(pool, 100);
+    void * alloc1 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc0);
+    assert_non_null(alloc1);
+    assert_int_equal(mem_del_alloc(pool, alloc0), ALLOC_OK);
+
+    void * alloc2 = mem_new_alloc(pool, 50);
+    assert_non_null(alloc2);
+    pool_segment_t exp1[4] =
+            {
+                    {100, 0},
+                    {100, 1},
+                    {50, 1},
+                    {pool->total_size - 250, 0},
+            };
+    check_metadata(pool, NEXT_FIT, POOL_SIZE, 150, 2, 2);
+    check_pool(pool, exp1);
+
+
+    void * alloc3 = mem_new_alloc(pool, pool->total_size - 250);
+    assert_non_null(alloc3);
+    void * alloc4 = mem_new_alloc(pool, 60);
+    assert_non_null(alloc4);
+    assert_true(alloc4 == alloc0);
+    pool_segment_t exp2[5] =
+            {
+                    {60, 1},
+                    {40, 0},
+                    {100, 1},
+                    {50, 1},
+                    {pool->total_size - 250, 1},
+            };
+    check_pool(pool, exp2);
+
+
+    assert_int_equal(mem_del_alloc(pool, alloc1), ALLOC_OK);
+    void * alloc5 = mem_new_alloc(pool, 10);
+    assert_non_null(alloc5);
+    pool_segment_t exp3[5] =
+            {
+                    {60, 1},
+                    {10, 1},
+                    {130, 0},
+                    {50, 1},
+                    {pool->total_size - 250, 1},
+            };
+    check_pool(pool, exp3);
+
+
+    assert_int_equal(mem_del_alloc(pool, alloc5), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc4), ALLOC_OK);
+    void * alloc6 = mem_new_alloc(pool, 5);
+    assert_non_null(alloc6);
+    assert_true(alloc6 == alloc0);
+    pool_segment_t exp4[4] =
+            {
+                    {5, 1},
+                    {195, 0},
+                    {50, 1},
+                    {pool->total_size - 250, 1},
+            };
+    check_metadata(pool, NEXT_FIT, POOL_SIZE, pool->total_size - 195, 3, 1);
+    check_pool(pool, exp4);
+
+
+    // clean up
+    assert_int_equal(mem_del_alloc(pool, alloc6), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc2), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc3), ALLOC_OK);
+
+    check_pool(pool, exp0);
+}
+
+/*******************************************/
+/***      9. SEGMENT VISITS/SLICES       ***/
+/*******************************************/
+
+typedef struct _visit_ctx {
+    pool_segment_t segs[8];
+    unsigned num_segs;
+    unsigned stop_after;
+} visit_ctx_t;
+
+static int visit_segment(const pool_segment_t *segment, void *ctx) {
+    visit_ctx_t *visit = (visit_ctx_t *) ctx;
+
+    if (visit->num_segs < 8) visit->segs[visit->num_segs] = *segment;
+    visit->num_segs ++;
+
+    return visit->num_segs == visit->stop_after;
+}
+
+static void test_pool_scenario25(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 25:
+     *
+     * 1. Pool starts out as a single gap.
+     * 2. Allocate 5 x 100, deallocate 1 and 3.
+     * 3. Visit all segments, then stop after the third.
+     * 4. Inspect in slices of 4: 4, 2, then none.
+     * 5. Slice 2, deallocate 2, so that no segment starts at the cursor,
+     *    and the next slice fails.
+     * 6. Clean up.
+     */
+
+    pool_segment_t exp0[1] =
+            {
+                    {pool->total_size, 0},
+            };
+    check_pool(pool, exp0);
+
+
+    void * allocs[5];
+    for (int i=0; i<5; ++i) {
+        allocs[i] = mem_new_alloc(pool, 100);
+        assert_non_null(allocs[i]);
+    }
+    assert_int_equal(mem_del_alloc(pool, allocs[1]), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, allocs[3]), ALLOC_OK);
+
+    pool_segment_t exp1[6] =
+            {
+                    {100, 1},
+                    {100, 0},
+                    {100, 1},
+                    {100, 0},
+                    {100, 1},
+                    {pool->total_size - 500, 0},
+            };
+    check_pool(pool, exp1);
+
+
+    visit_ctx_t visit = {{{0}}, 0, 0};
+    status = mem_pool_foreach_segment(pool, visit_segment, &visit);
+    assert_int_equal(status, ALLOC_OK);
+    assert_int_equal(visit.num_segs, 6);
+    for (unsigned u = 0; u < 6; u ++) {
+        assert_int_equal(visit.segs[u].size, exp1[u].size);
+        assert_int_equal(visit.segs[u].allocated, exp1[u].allocated);
+    }
+
+    visit.num_segs = 0;
+    visit.stop_after = 3;
+    status = mem_pool_foreach_segment(pool, visit_segment, &visit);
+    assert_int_equal(status, ALLOC_OK);
+    assert_int_equal(visit.num_segs, 3);
+
+
+    pool_cursor_t cursor = {0, 0};
+    pool_segment_t slice[4];
+    unsigned num_segs = 0;
+
+    status = mem_inspect_pool_slice(pool, &cursor, slice, 4, &num_segs);
+    assert_int_equal(status, ALLOC_OK);
+    assert_int_equal(num_segs, 4);
+    for (unsigned u = 0; u < 4; u ++) {
+        assert_int_equal(slice[u].size, exp1[u].size);
+        assert_int_equal(slice[u].allocated, exp1[u].allocated);
+    }
+    status = mem_inspect_pool_slice(pool, &cursor, slice, 4, &num_segs);
+    assert_int_equal(status, ALLOC_OK);
+    assert_int_equal(num_segs, 2);
+    for (unsigned u = 0; u < 2; u ++) {
+        assert_int_equal(slice[u].size, exp1[4 + u].size);
+        assert_int_equal(slice[u].allocated, exp1[4 + u].allocated);
+    }
+    status = mem_inspect_pool_slice(pool, &cursor, slice, 4, &num_segs);
+    assert_int_equal(status, ALLOC_OK);
+    assert_int_equal(num_segs, 0);
+
+
+    pool_cursor_t stale = {0, 0};
+    status = mem_inspect_pool_slice(pool, &stale, slice, 2, &num_segs);
+    assert_int_equal(status, ALLOC_OK);
+    assert_int_equal(num_segs, 2);
+    assert_int_equal(mem_del_alloc(pool, allocs[2]), ALLOC_OK);
+    status = mem_inspect_pool_slice(pool, &stale, slice, 2, &num_segs);
+    assert_int_equal(status, ALLOC_FAIL);
+    assert_int_equal(num_segs, 0);
+
+
+    assert_int_equal(mem_del_alloc(pool, allocs[0]), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, allocs[4]), ALLOC_OK);
+
+    check_pool(pool, exp0);
+}
+
+/*******************************************/
+/***          10. STATISTICS             ***/
+/*******************************************/
+
+static void test_pool_scenario26(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+    pool_stats_t stats;
+
+    /*
+     * Scenario 26:
+     *
+     * 1. Pool starts out as a single gap.
+     * 2. Allocate 100, 200, 300, 400, 500, deallocate 200 and 400.
+     * 3. Count the gaps below 300. Stats: 200 to the rest, 200 small.
+     * 4. Deallocate 300, which merges 200, 300, 400 into 900.
+     *    Stats: 900 to the rest, none small.
+     * 5. Allocate 250. Stats: 650 to the rest, none small.
+     * 6. Allocate 450. Stats: 200 to the rest, 200 small.
+     * 7. Clean up.
+     */
+
+    pool_segment_t exp0[1] =
+            {
+                    {pool->total_size, 0},
+            };
+    check_pool(pool, exp0);
+
+    status = mem_pool_stats(pool, &stats);
+    assert_int_equal(status, ALLOC_OK);
+    assert_int_equal(stats.free_size, pool->total_size);
+    assert_int_equal(stats.largest_gap, pool->total_size);
+    assert_int_equal(stats.smallest_gap, pool->total_size);
+    assert_int_equal(stats.small_gap_size, 0);
+    assert_true(stats.fragmentation == 0.0);
+
+
+    void * allocs[5];
+    for (int i=0; i<5; ++i) {
+        allocs[i] = mem_new_alloc(pool, 100 * (i + 1));
+        assert_non_null(allocs[i]);
+    }
+    assert_int_equal(mem_del_alloc(pool, allocs[1]), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, allocs[3]), ALLOC_OK);
+
+    size_t rest = pool->total_size - 1500;
+    status = mem_pool_track_small_gaps(pool, 300);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_pool_stats(pool, &stats);
+    assert_int_equal(status, ALLOC_OK);
+    assert_int_equal(stats.free_size, rest + 600);
+    assert_int_equal(stats.largest_gap, rest);
+    assert_int_equal(stats.smallest_gap, 200);
+    assert_int_equal(stats.small_gap_threshold, 300);
+    assert_int_equal(stats.small_gap_size, 200);
+    assert_true(stats.fragmentation == 1.0 - (double) rest / (rest + 600));
+
+
+    assert_int_equal(mem_del_alloc(pool, allocs[2]), ALLOC_OK);
+    status = mem_pool_stats(pool, &stats);
+    assert_int_equal(status, ALLOC_OK);
+    assert_int_equal(stats.largest_gap, rest);
+    assert_int_equal(stats.smallest_gap, 900);
+    assert_int_equal(stats.small_gap_size, 0);
+
+
+    void * alloc0 = mem_new_alloc(pool, 250);
+    assert_true(alloc0 == allocs[1]);
+    status = mem_pool_stats(pool, &stats);
+    assert_int_equal(status, ALLOC_OK);
+    assert_int_equal(stats.smallest_gap, 650);
+    assert_int_equal(stats.small_gap_size, 0);
+
+    void * alloc1 = mem_new_alloc(pool, 450);
+    assert_non_null(alloc1);
+    status = mem_pool_stats(pool, &stats);
+    assert_int_equal(status, ALLOC_OK);
+    assert_int_equal(stats.free_size, rest + 200);
+    assert_int_equal(stats.largest_gap, rest);
+    assert_int_equal(stats.smallest_gap, 200);
+    assert_int_equal(stats.small_gap_size, 200);
+
+
+    assert_int_equal(mem_del_alloc(pool, alloc0), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc1), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, allocs[0]), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, allocs[4]), ALLOC_OK);
+
+    check_pool(pool, exp0);
+
+    status = mem_pool_stats(pool, &stats);
+    assert_int_equal(status, ALLOC_OK);
+    assert_int_equal(stats.smallest_gap, pool->total_size);
+    assert_int_equal(stats.small_gap_size, 0);
+}
+
+/*******************************************/
+/***         11. THREAD SAFETY           ***/
+/*******************************************/
+
+static int pool_ts_setup(void **state) {
+    alloc_status status;
+    pool_pt pool = NULL;
+
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Allocating pool of %lu bytes with policy FIRST_FIT, thread-safe\n",
+         (long) POOL_SIZE);
+    pool = mem_pool_open_ex(POOL_SIZE, FIRST_FIT, POOL_THREAD_SAFE);
+    assert_non_null(pool);
+
+    *state = pool;
+
+    return 0;
+}
+
+static int pool_tc_setup(void **state) {
+    alloc_status status;
+    pool_pt pool = NULL;
+
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Allocating pool of %lu bytes with policy FIRST_FIT, thread caches\n",
+         (long) POOL_SIZE);
+    pool = mem_pool_open_ex(POOL_SIZE, FIRST_FIT, POOL_THREAD_CACHE);
+    assert_non_null(pool);
+
+    *state = pool;
+
+    return 0;
+}
+
+static int pool_buddy_tc_setup(void **state) {
+    alloc_status status;
+    pool_pt pool = NULL;
+
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Allocating pool of %lu bytes with policy BUDDY, thread caches\n",
+         (long) BUDDY_POOL_SIZE);
+    pool = mem_pool_open_ex(BUDDY_POOL_SIZE, BUDDY, POOL_THREAD_CACHE);
+    assert_non_null(pool);
+
+    *state = pool;
+
+    return 0;
+}
+
+static int pool_rf_setup(void **state) {
+    alloc_status status;
+    pool_pt pool = NULL;
+
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Allocating pool of %lu bytes with policy FIRST_FIT, remote free\n",
+         (long) POOL_SIZE);
+    pool = mem_pool_open_ex(POOL_SIZE, FIRST_FIT, POOL_REMOTE_FREE);
+    assert_non_null(pool);
+
+    *state = pool;
+
+    return 0;
+}
+
+static int pool_ts_rf_setup(void **state) {
+    alloc_status status;
+    pool_pt pool = NULL;
+
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Allocating pool of %lu bytes with policy FIRST_FIT, thread-safe, "
+         "remote free\n", (long) POOL_SIZE);
+    pool = mem_pool_open_ex(POOL_SIZE, FIRST_FIT,
+                            POOL_THREAD_SAFE | POOL_REMOTE_FREE);
+    assert_non_null(pool);
+
+    *state = pool;
+
+    return 0;
+}
+
+static int pool_sharded_setup(void **state) {
+    alloc_status status;
+    pool_pt pool = NULL;
+
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Allocating pool of %lu bytes with policy FIRST_FIT, 4 shards\n",
+         (long) POOL_SIZE);
+    pool = mem_pool_open_sharded(POOL_SIZE, FIRST_FIT, 4);
+    assert_non_null(pool);
+
+    *state = pool;
+
+    return 0;
+}
+
+typedef struct _thread_ctx {
+    pool_pt pool;
+    unsigned char id;
+    unsigned failures;
+} thread_ctx_t;
+
+static void *alloc_thread(void *arg) {
+    thread_ctx_t *ctx = (thread_ctx_t *) arg;
+    unsigned char *allocs[16] = {NULL};
+    size_t sizes[16] = {0};
+
+    // fill every allocation with the thread id, another thread writing over
+    // it means two threads got the same memory
+    for (unsigned i = 0; i < 4000; i ++) {
+        unsigned slot = (i * 7 + ctx->id) % 16;
+        if (allocs[slot]) {
+            for (size_t b = 0; b < sizes[slot]; b ++)
+                if (allocs[slot][b] != ctx->id) ctx->failures ++;
+            if (mem_del_alloc(ctx->pool, allocs[slot]) != ALLOC_OK)
+                ctx->failures ++;
+            allocs[slot] = NULL;
+        } else {
+            sizes[slot] = (i % 13 + 1) * 8;
+            allocs[slot] = mem_new_alloc(ctx->pool, sizes[slot]);
+            if (allocs[slot] == NULL) ctx->failures ++;
+            else memset(allocs[slot], ctx->id, sizes[slot]);
+        }
+    }
+    for (unsigned slot = 0; slot < 16; slot ++)
+        if (allocs[slot] && mem_del_alloc(ctx->pool, allocs[slot]) != ALLOC_OK)
+            ctx->failures ++;
+
+    return NULL;
+}
+
+static void test_pool_scenario27(void **state) {
+    pool_pt pool = *state;
+    pthread_t threads[4];
+    thread_ctx_t ctx[4];
+
+    /*
+     * Scenario 27:
+     *
+     * 1. Pool starts out as a single gap.
+     * 2. Four threads allocate and deallocate at the same time,
+     *    each checking that nobody wrote over its allocations.
+     * 3. Pool is back to a single gap.
+     */
+
+    pool_segment_t exp0[1] =
+            {
+                    {pool->total_size, 0},
+            };
+    check_pool(pool, exp0);
+
+    for (unsigned t = 0; t < 4; t ++) {
+        ctx[t].pool = pool;
+        ctx[t].id = (unsigned char) (t + 1);
+        ctx[t].failures = 0;
+        assert_int_equal(
+                pthread_create(&threads[t], NULL, alloc_thread, &ctx[t]), 0);
+    }
+    for (unsigned t = 0; t < 4; t ++) {
+        assert_int_equal(pthread_join(threads[t], NULL), 0);
+        assert_int_equal(ctx[t].failures, 0);
+    }
+
+    check_pool(pool, exp0);
+    assert_int_equal(pool->num_allocs, 0);
+    assert_int_equal(pool->alloc_size, 0);
+}
+
+static void test_pool_scenario28(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 28:
+     *
+     * 1. Pool starts out as a single gap.
+     * 2. Allocate 10 twice, from the thread cache. Inspection shows
+     *    both rounded up to 16, the rest of the cache is flushed.
+     * 3. Deallocate both. Inspection shows a single gap.
+     * 4. Allocate 300, too large for the cache, exact. Deallocate it.
+     * 5. Deallocating a pointer outside the pool fails right away.
+     */
+
+    pool_segment_t exp0[1] =
+            {
+                    {pool->total_size, 0},
+            };
+    check_pool(pool, exp0);
+
+    void *alloc0 = mem_new_alloc(pool, 10);
+    assert_non_null(alloc0);
+    void *alloc1 = mem_new_alloc(pool, 10);
+    assert_non_null(alloc1);
+    assert_true(alloc0 != alloc1);
+
+    pool_segment_pt segs = NULL;
+    unsigned num_segs = 0;
+    mem_inspect_pool(pool, &segs, &num_segs);
+    assert_non_null(segs);
+    unsigned num_allocs = 0;
+    for (unsigned u = 0; u < num_segs; u ++)
+        if (segs[u].allocated) {
+            assert_int_equal(segs[u].size, 16);
+            num_allocs ++;
+        }
+    free(segs);
+    assert_int_equal(num_allocs, 2);
+    assert_int_equal(pool->num_allocs, 2);
+    assert_int_equal(pool->alloc_size, 32);
+
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc1);
+    assert_int_equal(status, ALLOC_OK);
+    check_pool(pool, exp0);
+    assert_int_equal(pool->num_allocs, 0);
+
+    alloc0 = mem_new_alloc(pool, 300);
+    assert_non_null(alloc0);
+
+    pool_segment_t exp1[2] =
+            {
+                    {300, 1},
+                    {pool->total_size - 300, 0}
+            };
+    check_pool(pool, exp1);
+
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+    check_pool(pool, exp0);
+
+    status = mem_del_alloc(pool, (char *) pool->mem + pool->total_size);
+    assert_int_equal(status, ALLOC_FAIL);
+}
+
+typedef struct _remote_ctx {
+    pool_pt pool;
+    void *allocs[2];
+    alloc_status status[2];
+} remote_ctx_t;
+
+static void *remote_free_thread(void *arg) {
+    remote_ctx_t *ctx = (remote_ctx_t *) arg;
+
+    for (unsigned u = 0; u < 2; u ++)
+        ctx->status[u] = mem_del_alloc(ctx->pool, ctx->allocs[u]);
+
+    return NULL;
+}
+
+static void test_pool_scenario29(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+    pthread_t thread;
+    remote_ctx_t ctx;
+
+    /*
+     * Scenario 29:
+     *
+     * 1. Pool starts out as a single gap.
+     * 2. Allocate 100, 200, 300, and 1, which is rounded up to the size
+     *    of a pointer.
+     * 3. Another thread deallocates 100 and 300. They are queued, so
+     *    they still count as allocations.
+     * 4. Allocate 50, which takes the queue back first, and fits into
+     *    the gap that the 100 left.
+     * 5. Deallocate the rest.
+     */
+
+    pool_segment_t exp0[1] =
+            {
+                    {pool->total_size, 0},
+            };
+    check_pool(pool, exp0);
+
+    void *alloc0 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc0);
+    void *alloc1 = mem_new_alloc(pool, 200);
+    assert_non_null(alloc1);
+    void *alloc2 = mem_new_alloc(pool, 300);
+    assert_non_null(alloc2);
+    void *alloc3 = mem_new_alloc(pool, 1);
+    assert_non_null(alloc3);
+
+    size_t min_size = sizeof(char *);
+    pool_segment_t exp1[5] =
+            {
+                    {100, 1},
+                    {200, 1},
+                    {300, 1},
+                    {min_size, 1},
+                    {pool->total_size - 600 - min_size, 0}
+            };
+    check_pool(pool, exp1);
+
+    ctx.pool = pool;
+    ctx.allocs[0] = alloc0;
+    ctx.allocs[1] = alloc2;
+    assert_int_equal(
+            pthread_create(&thread, NULL, remote_free_thread, &ctx), 0);
+    assert_int_equal(pthread_join(thread, NULL), 0);
+    assert_int_equal(ctx.status[0], ALLOC_OK);
+    assert_int_equal(ctx.status[1], ALLOC_OK);
+    assert_int_equal(pool->num_allocs, 4);
+
+    void *alloc4 = mem_new_alloc(pool, 50);
+    assert_true(alloc4 == alloc0);
+    assert_int_equal(pool->num_allocs, 3);
+
+    pool_segment_t exp2[6] =
+            {
+                    {50, 1},
+                    {50, 0},
+                    {200, 1},
+                    {300, 0},
+                    {min_size, 1},
+                    {pool->total_size - 600 - min_size, 0}
+            };
+    check_pool(pool, exp2);
+
+    status = mem_del_alloc(pool, alloc1);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc3);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc4);
+    assert_int_equal(status, ALLOC_OK);
+    check_pool(pool, exp0);
+}
+
+static void test_pool_scenario30(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+    pthread_t threads[4];
+    thread_ctx_t ctx[4];
+
+    /*
+     * Scenario 30:
+     *
+     * 1. Pool starts out as four gaps, one per shard. Each shard is a
+     *    quarter of the pool, rounded down to a 64-byte multiple, and
+     *    the last one takes what is left over.
+     * 2. Allocate 200000 twice. The second one does not fit into what
+     *    is left of the home shard, so it comes from another one.
+     * 3. Allocate 260000, which no shard can hold, and fail.
+     * 4. Deallocate both. Pool is back to four gaps.
+     * 5. Four threads allocate and deallocate at the same time.
+     *    Pool is back to four gaps.
+     */
+
+    const size_t shard_size = POOL_SIZE / 4 / 64 * 64;
+    pool_segment_t exp0[4] =
+            {
+                    {shard_size, 0},
+                    {shard_size, 0},
+                    {shard_size, 0},
+                    {POOL_SIZE - 3 * shard_size, 0}
+            };
+    check_pool(pool, exp0);
+
+    void *alloc0 = mem_new_alloc(pool, 200000);
+    assert_non_null(alloc0);
+    void *alloc1 = mem_new_alloc(pool, 200000);
+    assert_non_null(alloc1);
+    assert_int_equal(pool->num_allocs, 2);
+    assert_int_equal(pool->alloc_size, 400000);
+    assert_int_equal(pool->num_gaps, 4);
+
+    void *alloc2 = mem_new_alloc(pool, 260000);
+    assert_null(alloc2);
+
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc1);
+    assert_int_equal(status, ALLOC_OK);
+    check_pool(pool, exp0);
+
+    for (unsigned t = 0; t < 4; t ++) {
+        ctx[t].pool = pool;
+        ctx[t].id = (unsigned char) (t + 1);
+        ctx[t].failures = 0;
+        assert_int_equal(
+                pthread_create(&threads[t], NULL, alloc_thread, &ctx[t]), 0);
+    }
+    for (unsigned t = 0; t < 4; t ++) {
+        assert_int_equal(pthread_join(threads[t], NULL), 0);
+        assert_int_equal(ctx[t].failures, 0);
+    }
+
+    check_pool(pool, exp0);
+    assert_int_equal(pool->num_allocs, 0);
+    assert_int_equal(pool->alloc_size, 0);
+}
+
+static void *open_close_thread(void *arg) {
+    unsigned *failures = (unsigned *) arg;
+    pool_pt pools[25];
+
+    // the store grows under the pools the other threads are closing
+    for (unsigned round = 0; round < 4; round ++) {
+        for (unsigned pix = 0; pix < 25; pix ++) {
+            pools[pix] = mem_pool_open(1000, (pix % 2) ? FIRST_FIT : BEST_FIT);
+            if (pools[pix] == NULL) (*failures) ++;
+        }
+        for (unsigned pix = 0; pix < 25; pix ++)
+            if (pools[pix] && mem_pool_close(pools[pix]) != ALLOC_OK)
+                (*failures) ++;
+    }
+
+    return NULL;
+}
+
+static void test_pool_store_threads(void **state) {
+    (void) state; /* unused */
+    pthread_t threads[4];
+    unsigned failures[4] = {0};
+
+    /*
+     * Four threads open and close 25 pools at a time, 100 each.
+     * Every pool opens and closes, and the store frees at the end.
+     */
+
+    assert_int_equal(mem_init(), ALLOC_OK);
+
+    for (unsigned t = 0; t < 4; t ++)
+        assert_int_equal(pthread_create(&threads[t], NULL,
+                                        open_close_thread, &failures[t]), 0);
+    for (unsigned t = 0; t < 4; t ++) {
+        assert_int_equal(pthread_join(threads[t], NULL), 0);
+        assert_int_equal(failures[t], 0);
+    }
+
+    assert_int_equal(mem_free(), ALLOC_OK);
+}
+
+/*******************************************/
+/***        12. BULK OPERATIONS          ***/
+/*******************************************/
+
+static void test_pool_scenario31(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+    void *allocs[3];
+    void *more[2];
+
+    /*
+     * Scenario 31:
+     *
+     * 1. Pool starts out as one gap.
+     * 2. Allocate 100, 400000 and 300 in one batch. They are carved out
+     *    of the gap one after the other.
+     * 3. Deallocate the 400000. Pool has a gap between the 100 and the
+     *    300.
+     * 4. Allocate 500000 and 450000 in one batch. Only the last gap can
+     *    hold the 500000 and then nothing can hold the 450000, so the
+     *    batch fails and the pool is left as it was.
+     * 5. Allocate 100 and 0 in one batch, and fail.
+     * 6. Allocate 500000 and 300000 in one batch. No gap holds both, so
+     *    each takes a gap of its own.
+     * 7. Deallocate everything. Pool is back to one gap.
+     */
+
+    const size_t sizes0[3] = {100, 400000, 300};
+    status = mem_new_alloc_batch(pool, sizes0, 3, allocs);
+    assert_int_equal(status, ALLOC_OK);
+    assert_ptr_equal(allocs[0], pool->mem);
+    assert_ptr_equal(allocs[1], pool->mem + 100);
+    assert_ptr_equal(allocs[2], pool->mem + 400100);
+    pool_segment_t exp0[4] =
+            {
+                    {100, 1},
+                    {400000, 1},
+                    {300, 1},
+                    {POOL_SIZE - 400400, 0}
+            };
+    check_pool(pool, exp0);
+
+    status = mem_del_alloc(pool, allocs[1]);
+    assert_int_equal(status, ALLOC_OK);
+    pool_segment_t exp1[4] =
+            {
+                    {100, 1},
+                    {400000, 0},
+                    {300, 1},
+                    {POOL_SIZE - 400400, 0}
+            };
+    check_pool(pool, exp1);
+
+    const size_t sizes1[2] = {500000, 450000};
+    status = mem_new_alloc_batch(pool, sizes1, 2, more);
+    assert_int_equal(status, ALLOC_FAIL);
+    check_pool(pool, exp1);
+    assert_int_equal(pool->num_allocs, 2);
+    assert_int_equal(pool->alloc_size, 400);
+
+    const size_t sizes2[2] = {100, 0};
+    status = mem_new_alloc_batch(pool, sizes2, 2, more);
+    assert_int_equal(status, ALLOC_FAIL);
+    check_pool(pool, exp1);
+
+    const size_t sizes3[2] = {500000, 300000};
+    status = mem_new_alloc_batch(pool, sizes3, 2, more);
+    assert_int_equal(status, ALLOC_OK);
+    assert_ptr_equal(more[0], pool->mem + 400400);
+    assert_ptr_equal(more[1], pool->mem + 100);
+    pool_segment_t exp2[6] =
+            {
+                    {100, 1},
+                    {300000, 1},
+                    {100000, 0},
+                    {300, 1},
+                    {500000, 1},
+                    {POOL_SIZE - 900400, 0}
+            };
+    check_pool(pool, exp2);
+
+    status = mem_del_alloc(pool, allocs[0]);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, allocs[2]);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, more[0]);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, more[1]);
+    assert_int_equal(status, ALLOC_OK);
+    pool_segment_t exp3[1] =
+            {
+                    {POOL_SIZE, 0}
+            };
+    check_pool(pool, exp3);
+}
+
+static void test_pool_scenario32(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+    void *allocs[6];
+
+    /*
+     * Scenario 32:
+     *
+     * 1. Pool starts out as one gap.
+     * 2. Allocate 100, 200, 300, 400, 500 and 600.
+     * 3. Deallocate the 400, the 200 and the 300 in one batch. They
+     *    merge into one gap.
+     * 4. Deallocate a batch with the 100 twice, and fail. Pool is left
+     *    as it was.
+     * 5. Deallocate a batch with the 100 and a pointer into the gap,
+     *    and fail. Pool is left as it was.
+     * 6. Deallocate the 600, the 100 and the 500 in one batch. Pool is
+     *    back to one gap.
+     */
+
+    for (unsigned u = 0; u < 6; u ++) {
+        allocs[u] = mem_new_alloc(pool, 100 * (u + 1));
+        assert_non_null(allocs[u]);
+    }
+
+    void *batch0[3] = {allocs[3], allocs[1], allocs[2]};
+    status = mem_del_alloc_batch(pool, batch0, 3);
+    assert_int_equal(status, ALLOC_OK);
+    pool_segment_t exp0[5] =
+            {
+                    {100, 1},
+                    {900, 0},
+                    {500, 1},
+                    {600, 1},
+                    {POOL_SIZE - 2100, 0}
+            };
+    check_pool(pool, exp0);
+    assert_int_equal(pool->num_allocs, 3);
+    assert_int_equal(pool->alloc_size, 1200);
+
+    void *batch1[2] = {allocs[0], allocs[0]};
+    status = mem_del_alloc_batch(pool, batch1, 2);
+    assert_int_equal(status, ALLOC_FAIL);
+    check_pool(pool, exp0);
+
+    void *batch2[2] = {allocs[0], allocs[1]};
+    status = mem_del_alloc_batch(pool, batch2, 2);
+    assert_int_equal(status, ALLOC_FAIL);
+    check_pool(pool, exp0);
+
+    void *batch3[3] = {allocs[5], allocs[0], allocs[4]};
+    status = mem_del_alloc_batch(pool, batch3, 3);
+    assert_int_equal(status, ALLOC_OK);
+    pool_segment_t exp1[1] =
+            {
+                    {POOL_SIZE, 0}
+            };
+    check_pool(pool, exp1);
+    assert_int_equal(pool->num_allocs, 0);
+    assert_int_equal(pool->alloc_size, 0);
+}
+
+static void test_pool_scenario33(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+    pool_segment_pt segs = NULL;
+    unsigned num_segs = 0;
+    unsigned num_gaps = pool->num_gaps;
+    void *allocs[4];
+    pool_stats_t stats0, stats;
+
+    /*
+     * Scenario 33:
+     *
+     * 1. Pool starts out empty. Take a picture of its segments and,
+     *    counting the gaps below 64, of its stats.
+     * 2. Allocate 16, 24, 32 and 40.
+     * 3. Deallocate the 24.
+     * 4. Reset the pool. It looks like it did when it was empty, and has
+     *    the same stats.
+     * 5. Allocate 40 and deallocate it.
+     * 6. Reset the pool again, with no allocations. Nothing changes.
+     * 7. BUDDY only: do 1, 2 and 4 on a pool with an 8-byte tail, which
+     *    stays a small gap through the reset.
+     */
+
+    mem_inspect_pool(pool, &segs, &num_segs);
+    assert_non_null(segs);
+    status = mem_pool_track_small_gaps(pool, 64);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_pool_stats(pool, &stats0);
+    assert_int_equal(status, ALLOC_OK);
+
+    for (unsigned u = 0; u < 4; u ++) {
+        allocs[u] = mem_new_alloc(pool, 16 + 8 * u);
+        assert_non_null(allocs[u]);
+    }
+    status = mem_del_alloc(pool, allocs[1]);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_pool_reset(pool);
+    assert_int_equal(status, ALLOC_OK);
+    check_pool(pool, segs);
+    assert_int_equal(pool->num_allocs, 0);
+    assert_int_equal(pool->alloc_size, 0);
+    assert_int_equal(pool->num_gaps, num_gaps);
+    status = mem_pool_stats(pool, &stats);
+    assert_int_equal(status, ALLOC_OK);
+    assert_int_equal(stats.free_size, stats0.free_size);
+    assert_int_equal(stats.largest_gap, stats0.largest_gap);
+    assert_int_equal(stats.smallest_gap, stats0.smallest_gap);
+    assert_int_equal(stats.small_gap_size, stats0.small_gap_size);
+
+    allocs[0] = mem_new_alloc(pool, 40);
+    assert_non_null(allocs[0]);
+    status = mem_del_alloc(pool, allocs[0]);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_pool_reset(pool);
+    assert_int_equal(status, ALLOC_OK);
+    check_pool(pool, segs);
+    assert_int_equal(pool->num_gaps, num_gaps);
+
+    free(segs);
+
+    if (pool->policy != BUDDY) return;
+
+    pool_pt tailed = mem_pool_open(BUDDY_POOL_SIZE + 8, BUDDY);
+    assert_non_null(tailed);
+    status = mem_pool_track_small_gaps(tailed, 64);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_pool_stats(tailed, &stats0);
+    assert_int_equal(status, ALLOC_OK);
+    assert_int_equal(stats0.small_gap_size, 8);
+
+    for (unsigned u = 0; u < 4; u ++)
+        assert_non_null(mem_new_alloc(tailed, 16 + 8 * u));
+    status = mem_pool_reset(tailed);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_pool_stats(tailed, &stats);
+    assert_int_equal(status, ALLOC_OK);
+    assert_int_equal(stats.free_size, stats0.free_size);
+    assert_int_equal(stats.largest_gap, stats0.largest_gap);
+    assert_int_equal(stats.smallest_gap, stats0.smallest_gap);
+    assert_int_equal(stats.small_gap_size, stats0.small_gap_size);
+
+    status = mem_pool_close(tailed);
+    assert_int_equal(status, ALLOC_OK);
+}
+
+static void test_pool_scenario34(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 34:
+     *
+     * 1. Pool starts out as one gap. Allocate 100.
+     * 2. Mark the pool, allocate 200 and 300, and release to the mark.
+     *    The two are carved from the top, so they go back in one piece.
+     * 3. Mark the pool, allocate 50, mark it again, allocate 60 and 70,
+     *    deallocate the 60, and release to the inner mark. Only the 70
+     *    goes. Then release to the outer mark. The 50 goes.
+     * 4. Allocate 400 and 100, deallocate the 400, mark the pool, and
+     *    allocate 300 and 1000. Where the 300 goes depends on the
+     *    policy. Release to the mark. Pool is back to where it was.
+     * 5. Release to the mark again. Nothing changes.
+     * 6. Reset the pool. The mark is void.
+     */
+
+    void *alloc0 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc0);
+    pool_segment_t exp0[2] =
+            {
+                    {100, 1},
+                    {POOL_SIZE - 100, 0}
+            };
+
+    pool_mark_t mark0 = mem_pool_mark(pool);
+    assert_non_null(mem_new_alloc(pool, 200));
+    assert_non_null(mem_new_alloc(pool, 300));
+    status = mem_pool_release_to_mark(pool, mark0);
+    assert_int_equal(status, ALLOC_OK);
+    check_pool(pool, exp0);
+    assert_int_equal(pool->num_allocs, 1);
+    assert_int_equal(pool->alloc_size, 100);
+
+    pool_mark_t mark1 = mem_pool_mark(pool);
+    assert_non_null(mem_new_alloc(pool, 50));
+    pool_mark_t mark2 = mem_pool_mark(pool);
+    void *alloc1 = mem_new_alloc(pool, 60);
+    assert_non_null(alloc1);
+    assert_non_null(mem_new_alloc(pool, 70));
+    status = mem_del_alloc(pool, alloc1);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_pool_release_to_mark(pool, mark2);
+    assert_int_equal(status, ALLOC_OK);
+    pool_segment_t exp1[3] =
+            {
+                    {100, 1},
+                    {50, 1},
+                    {POOL_SIZE - 150, 0}
+            };
+    check_pool(pool, exp1);
+    status = mem_pool_release_to_mark(pool, mark1);
+    assert_int_equal(status, ALLOC_OK);
+    check_pool(pool, exp0);
+
+    void *alloc2 = mem_new_alloc(pool, 400);
+    assert_non_null(alloc2);
+    void *alloc3 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc3);
+    status = mem_del_alloc(pool, alloc2);
+    assert_int_equal(status, ALLOC_OK);
+    pool_segment_t exp2[4] =
+            {
+                    {100, 1},
+                    {400, 0},
+                    {100, 1},
+                    {POOL_SIZE - 600, 0}
+            };
+    check_pool(pool, exp2);
+    pool_mark_t mark3 = mem_pool_mark(pool);
+    assert_non_null(mem_new_alloc(pool, 300));
+    assert_non_null(mem_new_alloc(pool, 1000));
+    status = mem_pool_release_to_mark(pool, mark3);
+    assert_int_equal(status, ALLOC_OK);
+    check_pool(pool, exp2);
+    status = mem_pool_release_to_mark(pool, mark3);
+    assert_int_equal(status, ALLOC_OK);
+    check_pool(pool, exp2);
+
+    status = mem_pool_reset(pool);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_pool_release_to_mark(pool, mark3);
+    assert_int_equal(status, ALLOC_FAIL);
+}
+
+static void test_pool_scenario35(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+    int outside = 0;
+
+    /*
+     * Scenario 35:
+     *
+     * 1. Pool starts out as one gap. Allocate 1000, 2000 and 1000, and
+     *    deallocate the 2000.
+     * 2. Reallocate the first 1000 to 2500 and then to 3000. It grows into
+     *    the gap after it, until the gap is gone, and does not move.
+     * 3. Reallocate it to 1200. The tail becomes a gap. Reallocate the
+     *    other 1000 to 400. Its tail joins the gap after it.
+     * 4. Reallocate the 1200 to 5000. The gap after it is too small, so it
+     *    moves to the top gap, and takes its contents along.
+     * 5. A size of 0, or a block that is not in the pool, fails and
+     *    changes nothing. A NULL block is a new allocation.
+     */
+
+    char *alloc0 = mem_new_alloc(pool, 1000);
+    assert_non_null(alloc0);
+    void *alloc1 = mem_new_alloc(pool, 2000);
+    assert_non_null(alloc1);
+    char *alloc2 = mem_new_alloc(pool, 1000);
+    assert_non_null(alloc2);
+    status = mem_del_alloc(pool, alloc1);
+    assert_int_equal(status, ALLOC_OK);
+    memset(alloc0, 'a', 1000);
+
+    assert_true(mem_realloc_alloc(pool, alloc0, 2500) == alloc0);
+    pool_segment_t exp0[4] =
+            {
+                    {2500, 1},
+                    {500, 0},
+                    {1000, 1},
+                    {POOL_SIZE - 4000, 0}
+            };
+    check_pool(pool, exp0);
+    assert_true(mem_realloc_alloc(pool, alloc0, 3000) == alloc0);
+    pool_segment_t exp1[3] =
+            {
+                    {3000, 1},
+                    {1000, 1},
+                    {POOL_SIZE - 4000, 0}
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, pool->policy, POOL_SIZE, 4000, 2, 1);
+
+    assert_true(mem_realloc_alloc(pool, alloc0, 1200) == alloc0);
+    assert_true(mem_realloc_alloc(pool, alloc2, 400) == alloc2);
+    pool_segment_t exp2[4] =
+            {
+                    {1200, 1},
+                    {1800, 0},
+                    {400, 1},
+                    {POOL_SIZE - 3400, 0}
+            };
+    check_pool(pool, exp2);
+    check_metadata(pool, pool->policy, POOL_SIZE, 1600, 2, 2);
+
+    char *moved = mem_realloc_alloc(pool, alloc0, 5000);
+    assert_non_null(moved);
+    assert_true(moved == alloc2 + 400);
+    for (unsigned u = 0; u < 1000; u ++) assert_int_equal(moved[u], 'a');
+    pool_segment_t exp3[4] =
+            {
+                    {3000, 0},
+                    {400, 1},
+                    {5000, 1},
+                    {POOL_SIZE - 8400, 0}
+            };
+    check_pool(pool, exp3);
+
+    assert_null(mem_realloc_alloc(pool, moved, 0));
+    assert_null(mem_realloc_alloc(pool, moved + 1, 100));
+    assert_null(mem_realloc_alloc(pool, &outside, 100));
+    check_pool(pool, exp3);
+    alloc0 = mem_realloc_alloc(pool, NULL, 100);
+    assert_non_null(alloc0);
+
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc2);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, moved);
+    assert_int_equal(status, ALLOC_OK);
+}
+
+static void test_pool_scenario36(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 36:
+     *
+     * 1. Buddy pool starts out as one block. Allocate 100, a block of 128.
+     * 2. Reallocate it to 512. Its buddies of 128 and 256 are free, so it
+     *    takes them and does not move.
+     * 3. Reallocate it to 20. It gives back its upper halves, down to a
+     *    block of 32.
+     * 4. Allocate 32, which takes the buddy of the first block. Reallocate
+     *    the first block to 64. Its buddy is taken, so it moves.
+     */
+
+    char *alloc0 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc0);
+    memset(alloc0, 'a', 100);
+
+    assert_true(mem_realloc_alloc(pool, alloc0, 512) == alloc0);
+    check_metadata(pool, BUDDY, BUDDY_POOL_SIZE, 512, 1, 11);
+
+    assert_true(mem_realloc_alloc(pool, alloc0, 20) == alloc0);
+    check_metadata(pool, BUDDY, BUDDY_POOL_SIZE, 32, 1, 15);
+
+    char *alloc1 = mem_new_alloc(pool, 32);
+    assert_true(alloc1 == alloc0 + 32);
+    char *moved = mem_realloc_alloc(pool, alloc0, 64);
+    assert_non_null(moved);
+    assert_true(moved != alloc0);
+    for (unsigned u = 0; u < 20; u ++) assert_int_equal(moved[u], 'a');
+    check_metadata(pool, BUDDY, BUDDY_POOL_SIZE, 96, 2, 14);
+
+    status = mem_del_alloc(pool, alloc1);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, moved);
+    assert_int_equal(status, ALLOC_OK);
+    check_metadata(pool, BUDDY, BUDDY_POOL_SIZE, 0, 0, 1);
+}
+
+static void *cache_free_thread(void *arg) {
+    remote_ctx_t *ctx = (remote_ctx_t *) arg;
+
+    ctx->status[0] = mem_del_alloc(ctx->pool, ctx->allocs[0]);
+
+    return NULL;
+}
+
+static void test_pool_scenario37(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+    pthread_t thread;
+    remote_ctx_t ctx;
+    char *allocs[12];
+
+    /*
+     * Scenario 37:
+     *
+     * 1. Allocate 32 from the thread cache and deallocate it twice, and a
+     *    pointer inside a block once. The deallocations are deferred, so
+     *    all of them succeed.
+     * 2. Allocate 32 twelve times, which sorts the deferred deallocations.
+     *    The block is handed out once, so all allocations differ.
+     * 3. Flushing the caches reports the two bad deallocations.
+     * 4. Another thread deallocates one of the blocks, and so does this
+     *    thread. Allocate 32 again. It differs from the others, and the
+     *    flush reports the second deallocation.
+     * 5. Deallocate the rest. The pool is a single gap again.
+     */
+
+    char *alloc0 = mem_new_alloc(pool, 32);
+    assert_non_null(alloc0);
+    char *alloc1 = mem_new_alloc(pool, 32);
+    assert_non_null(alloc1);
+
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc1 + 1);
+    assert_int_equal(status, ALLOC_OK);
+
+    for (unsigned u = 0; u < 12; u ++) {
+        allocs[u] = mem_new_alloc(pool, 32);
+        assert_non_null(allocs[u]);
+        assert_true(allocs[u] != alloc1);
+        for (unsigned v = 0; v < u; v ++)
+            assert_true(allocs[u] != allocs[v]);
+    }
+    assert_int_equal(mem_pool_flush_caches(pool), ALLOC_FAIL);
+    assert_int_equal(mem_pool_flush_caches(pool), ALLOC_OK);
+
+    ctx.pool = pool;
+    ctx.allocs[0] = allocs[0];
+    assert_int_equal(
+            pthread_create(&thread, NULL, cache_free_thread, &ctx), 0);
+    assert_int_equal(pthread_join(thread, NULL), 0);
+    assert_int_equal(ctx.status[0], ALLOC_OK);
+    status = mem_del_alloc(pool, allocs[0]);
+    assert_int_equal(status, ALLOC_OK);
+
+    char *alloc2 = mem_new_alloc(pool, 32);
+    assert_non_null(alloc2);
+    assert_true(alloc2 != alloc1);
+    for (unsigned u = 1; u < 12; u ++) assert_true(alloc2 != allocs[u]);
+    assert_int_equal(mem_pool_flush_caches(pool), ALLOC_FAIL);
+
+    status = mem_del_alloc(pool, alloc1);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc2);
+    assert_int_equal(status, ALLOC_OK);
+    for (unsigned u = 1; u < 12; u ++) {
+        status = mem_del_alloc(pool, allocs[u]);
+        assert_int_equal(status, ALLOC_OK);
+    }
+    assert_int_equal(mem_pool_flush_caches(pool), ALLOC_OK);
+
+    pool_segment_t exp0[1] =
+            {
+                    {pool->total_size, 0},
+            };
+    check_pool(pool, exp0);
+}
+
+static void *remote_misuse_thread(void *arg) {
+    remote_ctx_t *ctx = (remote_ctx_t *) arg;
+    char *end = ctx->pool->mem + ctx->pool->total_size;
+
+    // the link would run past the end of the pool
+    ctx->status[0] = mem_del_alloc(ctx->pool, end - 1);
+    // only the owner may reallocate in a pool without a lock
+    ctx->allocs[1] = mem_realloc_alloc(ctx->pool, ctx->allocs[0], 200);
+
+    return NULL;
+}
+
+static void test_pool_scenario38(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+    pthread_t thread;
+    remote_ctx_t ctx;
+
+    /*
+     * Scenario 38:
+     *
+     * 1. Allocate 100 in a POOL_REMOTE_FREE pool without POOL_THREAD_SAFE.
+     * 2. Another thread deallocates the last byte of the pool, which
+     *    fails, and reallocates the 100, which returns NULL.
+     * 3. The pool is as it was. Deallocate the 100.
+     */
+
+    void *alloc0 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc0);
+
+    pool_segment_t exp1[2] =
+            {
+                    {100, 1},
+                    {pool->total_size - 100, 0}
+            };
+    check_pool(pool, exp1);
+
+    ctx.pool = pool;
+    ctx.allocs[0] = alloc0;
+    assert_int_equal(
+            pthread_create(&thread, NULL, remote_misuse_thread, &ctx), 0);
+    assert_int_equal(pthread_join(thread, NULL), 0);
+    assert_int_equal(ctx.status[0], ALLOC_FAIL);
+    assert_null(ctx.allocs[1]);
+
+    void *alloc1 = mem_new_alloc(pool, 10);
+    assert_non_null(alloc1);
+    status = mem_del_alloc(pool, alloc1);
+    assert_int_equal(status, ALLOC_OK);
+    check_pool(pool, exp1);
+
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+    assert_int_equal(pool->num_allocs, 0);
+}
+
+static void test_pool_scenario39(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+    void *allocs[2];
+
+    /*
+     * Scenario 39:
+     *
+     * 1. NEXT_FIT pool. Allocate 100, 100 and the rest. Deallocate the
+     *    rest and the first 100. The rover is on the gap at 200.
+     * 2. Allocate 100 and the rest in one batch. The 100 takes the gap
+     *    at 200 and then nothing holds the rest, so the batch fails and
+     *    the pool is left as it was.
+     * 3. Allocate 10, which goes where the rover was, at 200.
+     */
+
+    size_t rest = pool->total_size - 200;
+    char *alloc0 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc0);
+    void *alloc1 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc1);
+    void *alloc2 = mem_new_alloc(pool, rest);
+    assert_non_null(alloc2);
+    status = mem_del_alloc(pool, alloc2);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+
+    pool_segment_t exp1[3] =
+            {
+                    {100, 0},
+                    {100, 1},
+                    {rest, 0}
+            };
+    check_pool(pool, exp1);
+
+    const size_t sizes[2] = {100, rest};
+    status = mem_new_alloc_batch(pool, sizes, 2, allocs);
+    assert_int_equal(status, ALLOC_FAIL);
+    check_pool(pool, exp1);
+
+    char *alloc3 = mem_new_alloc(pool, 10);
+    assert_true(alloc3 == alloc0 + 200);
+
+    status = mem_del_alloc(pool, alloc3);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc1);
+    assert_int_equal(status, ALLOC_OK);
+    assert_int_equal(pool->num_gaps, 1);
+}
+
+static void test_pool_scenario40(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 40:
+     *
+     * 1. Mark the pool, then allocate 128 and deallocate it 10000 times,
+     *    never releasing. The log stays short, a mark made then is not
+     *    deep.
+     * 2. Mark the pool, allocate 256, and commit the inner mark. Its
+     *    allocation now belongs to the outer mark. Commit the outer mark
+     *    too. The log is cleared, the 256 stays, and both marks are void.
+     * 3. Mark the pool twice, allocate 512, commit the inner mark, and
+     *    release to the outer one. The 512 goes.
+     */
+
+    pool_mark_t mark0 = mem_pool_mark(pool);
+    for (unsigned u = 0; u < 10000; u ++) {
+        void *alloc = mem_new_alloc(pool, 128);
+        assert_non_null(alloc);
+        status = mem_del_alloc(pool, alloc);
+        assert_int_equal(status, ALLOC_OK);
+    }
+    assert_int_equal(pool->num_allocs, 0);
+
+    pool_mark_t mark1 = mem_pool_mark(pool);
+    assert_true(mark1.depth <= 64);
+    void *alloc0 = mem_new_alloc(pool, 256);
+    assert_non_null(alloc0);
+    status = mem_pool_commit_mark(pool, mark1);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_pool_commit_mark(pool, mark1);
+    assert_int_equal(status, ALLOC_FAIL);
+    status = mem_pool_commit_mark(pool, mark0);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_pool_release_to_mark(pool, mark0);
+    assert_int_equal(status, ALLOC_FAIL);
+    assert_int_equal(pool->num_allocs, 1);
+    assert_int_equal(pool->alloc_size, 256);
+
+    pool_mark_t mark2 = mem_pool_mark(pool);
+    assert_int_equal(mark2.depth, 0);
+    pool_mark_t mark3 = mem_pool_mark(pool);
+    assert_non_null(mem_new_alloc(pool, 512));
+    status = mem_pool_commit_mark(pool, mark3);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_pool_release_to_mark(pool, mark2);
+    assert_int_equal(status, ALLOC_OK);
+    assert_int_equal(pool->num_allocs, 1);
+    assert_int_equal(pool->alloc_size, 256);
+
+    status = mem_pool_commit_mark(pool, mark2);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+    assert_int_equal(pool->num_allocs, 0);
+}
+
+static void test_pool_scenario41(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+    void *allocs[2];
+
+    /*
+     * Scenario 41:
+     *
+     * 1. Allocate the whole pool in one request, and deallocate it.
+     * 2. Allocate 100, then the rest of the pool in one request, which
+     *    takes the one gap exactly. Deallocate both.
+     * 3. Allocate the whole pool in one batch of two, and deallocate it.
+     */
+
+    pool_segment_t exp0[1] =
+            {
+                    {pool->total_size, 0},
+            };
+
+    char *alloc0 = mem_new_alloc(pool, pool->total_size);
+    assert_true(alloc0 == pool->mem);
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+    check_pool(pool, exp0);
+
+    alloc0 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc0);
+    void *alloc1 = mem_new_alloc(pool, pool->total_size - 100);
+    assert_true(alloc1 == alloc0 + 100);
+    assert_int_equal(pool->num_gaps, 0);
+    status = mem_del_alloc(pool, alloc1);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+    check_pool(pool, exp0);
+
+    const size_t sizes[2] = {100, pool->total_size - 100};
+    status = mem_new_alloc_batch(pool, sizes, 2, allocs);
+    assert_int_equal(status, ALLOC_OK);
+    assert_int_equal(pool->num_gaps, 0);
+    status = mem_del_alloc_batch(pool, allocs, 2);
+    assert_int_equal(status, ALLOC_OK);
+    check_pool(pool, exp0);
+}
+
+static void *remote_double_free_thread(void *arg) {
+    remote_ctx_t *ctx = (remote_ctx_t *) arg;
+
+    ctx->status[0] = mem_del_alloc(ctx->pool, ctx->allocs[0]);
+    ctx->status[1] = mem_del_alloc(ctx->pool, ctx->allocs[0]);
+    mem_del_alloc(ctx->pool, ctx->allocs[1]);
+
+    return NULL;
+}
+
+static void test_pool_scenario42(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+    pthread_t thread;
+    remote_ctx_t ctx;
+
+    /*
+     * Scenario 42:
+     *
+     * 1. Allocate 100 and 200 in a POOL_REMOTE_FREE pool.
+     * 2. Another thread deallocates the 100 twice, then the 200. The
+     *    deallocations are queued, so all of them succeed, and the 100
+     *    now links to itself.
+     * 3. Allocate 50, which takes the queue back first. It returns, the
+     *    queue ends at the 100 the second time around.
+     * 4. Flushing reports the double free. Deallocate the 50. The pool
+     *    is a single gap again.
+     */
+
+    void *alloc0 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc0);
+    void *alloc1 = mem_new_alloc(pool, 200);
+    assert_non_null(alloc1);
+
+    ctx.pool = pool;
+    ctx.allocs[0] = alloc0;
+    ctx.allocs[1] = alloc1;
+    assert_int_equal(
+            pthread_create(&thread, NULL, remote_double_free_thread, &ctx),
+            0);
+    assert_int_equal(pthread_join(thread, NULL), 0);
+    assert_int_equal(ctx.status[0], ALLOC_OK);
+    assert_int_equal(ctx.status[1], ALLOC_OK);
+
+    void *alloc2 = mem_new_alloc(pool, 50);
+    assert_true(alloc2 == alloc0);
+    assert_int_equal(pool->num_allocs, 1);
+    assert_int_equal(mem_pool_flush_caches(pool), ALLOC_FAIL);
+    assert_int_equal(mem_pool_flush_caches(pool), ALLOC_OK);
+
+    status = mem_del_alloc(pool, alloc2);
+    assert_int_equal(status, ALLOC_OK);
+    pool_segment_t exp0[1] =
+            {
+                    {pool->total_size, 0},
+            };
+    check_pool(pool, exp0);
+}
+
+/*******************************************/
+/***        13. STRESS TESTING           ***/
+/*******************************************/
+
+void test_pool_stresstest0(void **state) {
+    (void) state; /* unused */
+
+    const unsigned num_pools = 200;
+    const unsigned num_allocations = 1000;
+    const unsigned min_alloc_size = 10;
+    const unsigned pool_size =
+            (num_allocations / 2) *
+            (2 * min_alloc_size + (num_allocations - 1) * min_alloc_size);
+    assert_int_equal(pool_size, 5005000);
+
+
+    pool_pt pools[num_pools];
+    void *allocations[num_pools][num_allocations];
+
+    /*
+     * Testing dynamic reallocation of pool structures:
+     *
+     * 1. 200 pools of 5005000 each (many pools)
+     * 2. In each pool 1000 allocations of different sizes (many allocations)
+     * 3. In each pool 500 deallocations (many gaps)
+     */
+
+    // initialize store
+    assert_int_equal(mem_init(), ALLOC_OK);
+
+    // allocate pools
+    for (unsigned pix=0; pix < num_pools; ++pix) {
+        // open pool
+        pools[pix] =
+                mem_pool_open(pool_size, (pix % 2) ? FIRST_FIT : BEST_FIT);
+        assert_non_null(pools[pix]);
+        // allocate pool
+        unsigned allocated = 0;
+        for (unsigned aix=0; aix < num_allocations; ++aix) {
+            allocations[pix][aix] =
+                    mem_new_alloc(pools[pix], (aix + 1) * min_alloc_size);
+            allocated += (aix + 1) * min_alloc_size;
+            if (!allocations[pix][aix]) {
+                INFO("ASSERT WILL FAIL at pix = %u, aix = %u, allocated = %u\n", pix, aix, allocated);
+            }
+            assert_non_null(allocations[pix][aix]);
+        }
+
+        // delete every other allocation
+        for (unsigned aix=0; aix < num_allocations; ++aix) {
+            if (aix % 2) {
+                assert_int_equal(
+                        mem_del_alloc(pools[pix], allocations[pix][aix]),
+                        ALLOC_OK);
+                allocations[pix][aix] = NULL;
+            }
+        }
+    }
+
+    // delete pools
+    for (unsigned pix=0; pix < num_pools; ++pix) {
+        // delete pool's allocations
+        for (unsigned aix=0; aix < num_allocations; ++aix) {
+            if (allocations[pix][aix]) {
+                // delete allocation
+                assert_int_equal(
+                        mem_del_alloc(pools[pix], allocations[pix][aix]),
+                        ALLOC_OK);
+            }
+        }
+        // close pool
+        assert_int_equal(mem_pool_close(pools[pix]), ALLOC_OK);
+    }
+
+    // free store
+    assert_int_equal(mem_free(), ALLOC_OK);
+}
+
+
+/*******************************************/
+/***        14. DRIVER ROUTINE           ***/
+/*******************************************/
+
+int run_test_suite() {
+    const struct CMUnitTest tests[] = {
+            // General tests
+            cmocka_unit_test(test_pool_store_smoketest),
+            cmocka_unit_test(test_pool_smoketest),
+
+            cmocka_unit_test(test_pool_nonempty),
+
+            cmocka_unit_test_setup_teardown(test_pool_ff_metadata, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_bf_metadata, pool_bf_setup, pool_bf_teardown),
+
+            // First-fit tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario00, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario01, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario02, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario03, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario04, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario05, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario06, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario07, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario08, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario09, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario10, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario24, pool_ff_setup, pool_ff_teardown),
+
+            // Best-fit tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario11, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario12, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario13, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario14, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario15, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario16, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario17, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario18, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario19, pool_bf_setup, pool_bf_teardown),
+
+            // Best-fit tests, gap tree index
+            cmocka_unit_test_setup_teardown(test_pool_bf_metadata, pool_bf_tree_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario11, pool_bf_tree_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario12, pool_bf_tree_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario13, pool_bf_tree_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario14, pool_bf_tree_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario15, pool_bf_tree_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario16, pool_bf_tree_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario17, pool_bf_tree_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario18, pool_bf_tree_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario19, pool_bf_tree_setup, pool_bf_teardown),
+
+            // TLSF tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario20, pool_tlsf_setup, pool_tlsf_teardown),
+
+            // Buddy tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario21, pool_buddy_setup, pool_buddy_teardown),
+
+            // Slab tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario22, pool_slab_setup, pool_slab_teardown),
+
+            // Next-fit tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario23, pool_nf_setup, pool_nf_teardown),
+
+            // Segment visit and slice tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario25, pool_ff_setup, pool_ff_teardown),
+
+            // Statistics tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario26, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario26, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario26, pool_bf_tree_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario26, pool_tlsf_setup, pool_tlsf_teardown),
+
+            // Thread-safety tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario05, pool_ts_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario25, pool_ts_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario26, pool_ts_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario27, pool_ts_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario27, pool_tc_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario27, pool_buddy_tc_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario28, pool_tc_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario27, pool_ts_rf_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario29, pool_rf_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario29, pool_ts_rf_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario30, pool_sharded_setup, pool_ff_teardown),
+            cmocka_unit_test(test_pool_store_threads),
+
+            // Bulk operation tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario31, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario31, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario31, pool_bf_tree_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario31, pool_tlsf_setup, pool_tlsf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario31, pool_nf_setup, pool_nf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario31, pool_ts_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario31, pool_tc_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario32, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario32, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario32, pool_bf_tree_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario32, pool_tlsf_setup, pool_tlsf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario32, pool_nf_setup, pool_nf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario32, pool_ts_rf_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario33, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario33, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario33, pool_bf_tree_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario33, pool_tlsf_setup, pool_tlsf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario33, pool_buddy_setup, pool_buddy_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario33, pool_slab_setup, pool_slab_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario33, pool_nf_setup, pool_nf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario33, pool_tc_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario33, pool_ts_rf_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario33, pool_sharded_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario34, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario34, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario34, pool_bf_tree_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario34, pool_tlsf_setup, pool_tlsf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario34, pool_nf_setup, pool_nf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario34, pool_ts_rf_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario35, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario35, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario35, pool_bf_tree_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario35, pool_tlsf_setup, pool_tlsf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario35, pool_nf_setup, pool_nf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario35, pool_ts_rf_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario36, pool_buddy_setup, pool_buddy_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario37, pool_tc_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario38, pool_rf_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario39, pool_nf_setup, pool_nf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario40, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario40, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario40, pool_tlsf_setup, pool_tlsf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario40, pool_buddy_setup, pool_buddy_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario40, pool_nf_setup, pool_nf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario41, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario41, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario41, pool_tlsf_setup, pool_tlsf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario42, pool_rf_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario42, pool_ts_rf_setup, pool_ff_teardown),
 
             // Stress tests
             cmocka_unit_test(test_pool_stresstest0),